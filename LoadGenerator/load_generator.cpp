@@ -21,13 +21,18 @@ struct Config {
   int num_threads = 4;
   int duration_seconds = 60;
   int warmup_seconds = 10;
-  string workload_type = "mixed"; // read, write, mixed, search, update
+  string workload_type = "mixed"; // read, write, mixed, search, update, bulk
   double read_ratio = 0.7;  // For mixed workload
   double write_ratio = 0.2;
   double search_ratio = 0.1;
   int think_time_ms = 0;  // Think time between requests
+  int batch_size = 1000;  // Movies per request of the bulk workload
 };
 
+// Operation types, used for the per-operation latency breakdown
+enum OpType { OP_ADD, OP_LIST, OP_SEARCH, OP_UPDATE, OP_DELETE, OP_BULK, OP_COUNT };
+static const char *OP_NAMES[OP_COUNT] = {"ADD", "LIST", "SEARCH", "UPDATE", "DELETE", "BULK"};
+
 // Statistics
 struct Stats {
   atomic<long long> total_requests{0};
@@ -40,13 +45,17 @@ struct Stats {
   atomic<long long> search_count{0};
   atomic<long long> update_count{0};
   atomic<long long> delete_count{0};
+  atomic<long long> bulk_count{0};
+  atomic<long long> bulk_movies{0};  // movies stored by successful bulk requests
 
   vector<double> latencies;
+  vector<double> op_latencies[OP_COUNT];
   mutex latency_mutex;
 
-  void record_latency(double latency_ms) {
+  void record_latency(OpType op, double latency_ms) {
     lock_guard<mutex> lock(latency_mutex);
     latencies.push_back(latency_ms);
+    op_latencies[op].push_back(latency_ms);
   }
 
   void print_stats(int duration) {
@@ -83,6 +92,10 @@ struct Stats {
     cout << "  SEARCH: " << search_count << "\n";
     cout << "  UPDATE: " << update_count << "\n";
     cout << "  DELETE: " << delete_count << "\n";
+    if (bulk_count > 0) {
+      cout << "  BULK: " << bulk_count << " (" << bulk_movies << " movies, "
+           << fixed << setprecision(2) << (double)bulk_movies / duration << " movies/s)\n";
+    }
 
     if (!latencies.empty()) {
       sort(latencies.begin(), latencies.end());
@@ -96,6 +109,22 @@ struct Stats {
       cout << "  P99: " << latencies[(int)(latencies.size() * 0.99)] << "\n";
       cout << "  Min: " << latencies[0] << "\n";
       cout << "  Max: " << latencies[latencies.size() - 1] << "\n";
+
+      cout << "\nPer-Operation Latency (ms):\n";
+      cout << "  " << left << setw(8) << "OP" << right << setw(10) << "Count"
+           << setw(10) << "Mean" << setw(10) << "Median" << setw(10) << "P95"
+           << setw(10) << "P99" << "\n";
+      for (int op = 0; op < OP_COUNT; op++) {
+        vector<double> &lat = op_latencies[op];
+        if (lat.empty()) continue;
+        sort(lat.begin(), lat.end());
+        double op_sum = 0;
+        for (double l : lat) op_sum += l;
+        cout << "  " << left << setw(8) << OP_NAMES[op] << right << setw(10) << lat.size()
+             << setw(10) << op_sum / lat.size() << setw(10) << lat[lat.size() / 2]
+             << setw(10) << lat[(int)(lat.size() * 0.95)]
+             << setw(10) << lat[(int)(lat.size() * 0.99)] << "\n";
+      }
     }
     cout << "=======================================\n";
   }
@@ -183,6 +212,7 @@ private:
 
   atomic<bool>& running;
   int worker_id;
+  OpType last_op = OP_LIST;  // operation issued by the last perform_* call
 
 public:
   LoadWorker(const Config& cfg, Stats& st, atomic<bool>& run, int id) 
@@ -208,6 +238,8 @@ public:
         success = perform_search();
       } else if (config.workload_type == "update") {
         success = perform_update();
+      } else if (config.workload_type == "bulk") {
+        success = perform_bulk_add();
       } else {  // mixed
         success = perform_mixed_operation(op_choice);
       }
@@ -219,7 +251,7 @@ public:
       if (success) {
         stats.successful_requests++;
         if (latency_ms >= 0) {  // Only record valid latencies
-          stats.record_latency(latency_ms);
+          stats.record_latency(last_op, latency_ms);
         }
       } else {
         stats.failed_requests++;
@@ -262,6 +294,7 @@ private:
 
   bool perform_add() {
     stats.add_count++;
+    last_op = OP_ADD;
     string title = movie_gen.generate_title();
     string genre = movie_gen.generate_genre();
     int year = movie_gen.generate_year();
@@ -276,14 +309,34 @@ private:
     return res && res->status == 200;
   }
 
+  // Post batch_size movies as NDJSON, one object per line
+  bool perform_bulk_add() {
+    stats.bulk_count++;
+    last_op = OP_BULK;
+    string body;
+    for (int i = 0; i < config.batch_size; i++) {
+      body += "{\"title\":\"" + movie_gen.generate_title() +
+              "\",\"genre\":\"" + movie_gen.generate_genre() +
+              "\",\"release_year\":" + to_string(movie_gen.generate_year()) +
+              ",\"rating\":" + to_string(movie_gen.generate_rating()) + "}\n";
+    }
+
+    auto res = client.Post("/add-movies", body, "application/x-ndjson");
+    if (!res || res->status != 200) return false;
+    stats.bulk_movies += config.batch_size;
+    return true;
+  }
+
   bool perform_list() {
     stats.list_count++;
+    last_op = OP_LIST;
     auto res = client.Get("/list-movies");
     return res && res->status == 200;
   }
 
   bool perform_search() {
     stats.search_count++;
+    last_op = OP_SEARCH;
     string title = movie_gen.get_random_existing_title();
     string path = "/search-movie?title=" + title;
     auto res = client.Get(path);
@@ -292,6 +345,7 @@ private:
 
   bool perform_update() {
     stats.update_count++;
+    last_op = OP_UPDATE;
     int id = id_dist(gen);
     double rating = movie_gen.generate_rating();
 
@@ -310,6 +364,7 @@ private:
 
   bool perform_delete() {
     stats.delete_count++;
+    last_op = OP_DELETE;
     int id = id_dist(gen);
     string path = "/delete-movie?id=" + to_string(id);
     auto res = client.Delete(path);
@@ -334,10 +389,11 @@ void print_usage() {
   cout << "  --threads <num>          Number of threads (default: 4)\n";
   cout << "  --duration <seconds>     Test duration (default: 60)\n";
   cout << "  --warmup <seconds>       Warmup period (default: 10)\n";
-  cout << "  --workload <type>        Workload type: read, write, mixed, search, update (default: mixed)\n";
+  cout << "  --workload <type>        Workload type: read, write, mixed, search, update, bulk (default: mixed)\n";
   cout << "  --read-ratio <ratio>     Read ratio for mixed workload (default: 0.7)\n";
   cout << "  --write-ratio <ratio>    Write ratio for mixed workload (default: 0.2)\n";
   cout << "  --think-time <ms>        Think time between requests (default: 0)\n";
+  cout << "  --batch-size <num>       Movies per request of the bulk workload (default: 1000)\n";
   cout << "  --output <filename>      CSV output file for latencies (default: latencies.csv)\n";
   cout << "  --help                   Show this help message\n";
 }
@@ -370,6 +426,8 @@ int main(int argc, char* argv[]) {
       config.write_ratio = stod(argv[++i]);
     } else if (arg == "--think-time" && i + 1 < argc) {
       config.think_time_ms = stoi(argv[++i]);
+    } else if (arg == "--batch-size" && i + 1 < argc) {
+      config.batch_size = stoi(argv[++i]);
     } else if (arg == "--output" && i + 1 < argc) {
       output_file = argv[++i];
     }
@@ -385,6 +443,9 @@ int main(int argc, char* argv[]) {
     cout << "Read Ratio: " << config.read_ratio << "\n";
     cout << "Write Ratio: " << config.write_ratio << "\n";
   }
+  if (config.workload_type == "bulk") {
+    cout << "Batch Size: " << config.batch_size << " movies\n";
+  }
   cout << "====================================\n\n";
 
   // Test server connectivity
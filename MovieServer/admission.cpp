@@ -0,0 +1,129 @@
+#include "admission.h"
+#include "logger.h"
+
+using Clock = chrono::steady_clock;
+
+// Verdict for the job running on this thread, set by AdmissionQueue
+static thread_local bool shedVerdict = false;
+
+static int64_t now_ticks() {
+  return Clock::now().time_since_epoch().count();
+}
+
+// Constructor: the first interval starts now
+AdmissionController::AdmissionController(const AdmissionConfig &config)
+    : config(config),
+      intervalEnd(now_ticks() + chrono::duration_cast<Clock::duration>(config.interval).count()),
+      minSojournUs(UINT64_MAX) {}
+
+// Decide whether the interval that just ended was overloaded and start the
+// next one. Only the thread that moves intervalEnd on does this.
+void AdmissionController::closeInterval(int64_t now) {
+  int64_t end = intervalEnd.load(memory_order_relaxed);
+  if (now < end) return;
+  int64_t next = now + chrono::duration_cast<Clock::duration>(config.interval).count();
+  if (!intervalEnd.compare_exchange_strong(end, next)) return;
+
+  // An interval without jobs had nothing waiting, nor did a quiet spell
+  // that left intervals unclosed
+  uint64_t minimum = minSojournUs.exchange(UINT64_MAX);
+  bool quiet = now - end >= chrono::duration_cast<Clock::duration>(config.interval).count();
+  bool standing = !quiet && minimum != UINT64_MAX && minimum > (uint64_t)config.target.count();
+  if (standing != overloaded.load(memory_order_relaxed)) {
+    if (standing) {
+      LOG_DEBUG("Overloaded: no request waited less than %llu us in the last %lld ms, shedding late ones",
+               (unsigned long long)minimum, (long long)config.interval.count() / 1000);
+    } else {
+      LOG_DEBUG("Queue drained, no longer overloaded");
+    }
+  }
+  overloaded = standing;
+  if (standing) overloadedIntervals.fetch_add(1, memory_order_relaxed);
+}
+
+// Record a job's wait and decide whether it may run
+bool AdmissionController::admit(chrono::microseconds sojourn, size_t queued) {
+  closeInterval(now_ticks());
+
+  uint64_t us = sojourn.count() > 0 ? sojourn.count() : 0;
+  uint64_t seen = minSojournUs.load(memory_order_relaxed);
+  while (us < seen && !minSojournUs.compare_exchange_weak(seen, us, memory_order_relaxed)) {}
+  seen = maxSojournUs.load(memory_order_relaxed);
+  while (us > seen && !maxSojournUs.compare_exchange_weak(seen, us, memory_order_relaxed)) {}
+
+  if (config.maxQueued > 0 && queued >= config.maxQueued) {
+    shedQueueFull.fetch_add(1, memory_order_relaxed);
+    return false;
+  }
+  chrono::microseconds limit = overloaded.load(memory_order_relaxed) ? config.target : config.interval;
+  if (sojourn > limit) {
+    shedDelay.fetch_add(1, memory_order_relaxed);
+    return false;
+  }
+  admitted.fetch_add(1, memory_order_relaxed);
+  return true;
+}
+
+// Get admission counters
+AdmissionStats AdmissionController::stats() const {
+  AdmissionStats s;
+  s.admitted = admitted.load(memory_order_relaxed);
+  s.shedDelay = shedDelay.load(memory_order_relaxed);
+  s.shedQueueFull = shedQueueFull.load(memory_order_relaxed);
+  s.overloadedIntervals = overloadedIntervals.load(memory_order_relaxed);
+  s.overloaded = overloaded.load(memory_order_relaxed);
+  s.maxSojournUs = maxSojournUs.load(memory_order_relaxed);
+  return s;
+}
+
+// Constructor: takes ownership of the wrapped queue
+AdmissionQueue::AdmissionQueue(httplib::TaskQueue *inner, AdmissionController &controller)
+    : inner(inner), controller(controller) {}
+
+// Stamp the job and count it as queued until a worker starts it
+bool AdmissionQueue::enqueue(function<void()> fn) {
+  Clock::time_point queuedAt = Clock::now();
+  queued.fetch_add(1, memory_order_relaxed);
+  bool accepted = inner->enqueue([this, queuedAt, fn = std::move(fn)]() {
+    size_t behind = queued.fetch_sub(1, memory_order_relaxed) - 1;
+    auto sojourn = chrono::duration_cast<chrono::microseconds>(Clock::now() - queuedAt);
+    shedVerdict = !controller.admit(sojourn, behind);
+    fn();
+    shedVerdict = false;
+  });
+  if (!accepted) queued.fetch_sub(1, memory_order_relaxed);
+  return accepted;
+}
+
+// Stop the wrapped queue
+void AdmissionQueue::shutdown() {
+  inner->shutdown();
+}
+
+// Read and clear this thread's verdict
+bool AdmissionQueue::shedCurrent() {
+  bool shed = shedVerdict;
+  shedVerdict = false;
+  return shed;
+}
+
+// Requests that waited too long get a 503 without touching the database or
+// cache. /metrics is always answered so overload stays observable. The 503
+// also closes the connection: httplib keeps a keep-alive connection on its
+// worker until the client hangs up, so a shed client that stayed connected
+// would hold on to the very worker shedding was meant to free. httplib only
+// writes `Connection: close` and leaves hanging up to the client, so the body
+// goes out through a provider that reports failure once it is all written:
+// httplib then drops the connection (the epoll front end closes on the header).
+httplib::Server::HandlerResponse shed_overload(const httplib::Request &req, httplib::Response &res) {
+  if (!AdmissionQueue::shedCurrent() || req.path == "/metrics") return httplib::Server::HandlerResponse::Unhandled;
+  res.status = 503;
+  res.set_header("Retry-After", to_string(ADMISSION_RETRY_AFTER_SEC));
+  res.set_header("Connection", "close");
+  static const string body = "Server overloaded, retry later";
+  res.set_content_provider(body.size(), "text/plain", [](size_t offset, size_t length, httplib::DataSink &sink) {
+    sink.write(body.data() + offset, length);
+    return false;
+  });
+  return httplib::Server::HandlerResponse::Handled;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <httplib.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+using namespace std;
+
+#define ADMISSION_TARGET_MS 5        // queueing delay tolerated while the queue never drains
+#define ADMISSION_INTERVAL_MS 100    // window the minimum delay is taken over; also the delay tolerated otherwise
+#define ADMISSION_RETRY_AFTER_SEC 1  // Retry-After of shed requests
+
+struct AdmissionConfig {
+  chrono::microseconds target{ADMISSION_TARGET_MS * 1000};
+  chrono::microseconds interval{ADMISSION_INTERVAL_MS * 1000};
+  size_t maxQueued = 0;  // shed once this many jobs wait ahead of one; 0 = no depth limit
+};
+
+// Admission counters
+struct AdmissionStats {
+  size_t admitted = 0;
+  size_t shedDelay = 0;       // waited longer than the current limit
+  size_t shedQueueFull = 0;   // too many jobs ahead
+  size_t overloadedIntervals = 0;
+  bool overloaded = false;
+  uint64_t maxSojournUs = 0;  // longest wait seen, admitted or not
+};
+
+// CoDel-style admission decision, made when a worker picks a job up.
+//
+// A queue that is only absorbing a burst drains at some point, so the
+// smallest wait within an interval drops to near zero. If even the
+// smallest wait of a whole interval is above target, the queue is standing
+// and the server is overloaded. Jobs are then only admitted if they waited
+// less than target, otherwise less than interval. Shedding the late ones
+// keeps the delay of the admitted ones bounded instead of letting every
+// request wait behind the backlog.
+class AdmissionController {
+  private:
+    AdmissionConfig config;
+    atomic<int64_t> intervalEnd;          // steady_clock ticks when the current interval closes
+    atomic<uint64_t> minSojournUs;        // smallest wait in the current interval
+    atomic<bool> overloaded{false};
+    atomic<size_t> admitted{0};
+    atomic<size_t> shedDelay{0};
+    atomic<size_t> shedQueueFull{0};
+    atomic<size_t> overloadedIntervals{0};
+    atomic<uint64_t> maxSojournUs{0};
+
+    void closeInterval(int64_t now);
+
+  public:
+    explicit AdmissionController(const AdmissionConfig &config = {});
+
+    // Whether a job that waited sojourn with queued jobs behind it may run
+    bool admit(chrono::microseconds sojourn, size_t queued);
+
+    AdmissionStats stats() const;
+};
+
+// Task queue decorator that times each job from enqueue to start and asks
+// the controller about it. The job runs either way, so it can answer; a
+// job that should be shed finds out through shedCurrent().
+class AdmissionQueue : public httplib::TaskQueue {
+  private:
+    unique_ptr<httplib::TaskQueue> inner;
+    AdmissionController &controller;
+    atomic<size_t> queued{0};
+
+  public:
+    AdmissionQueue(httplib::TaskQueue *inner, AdmissionController &controller);
+
+    bool enqueue(function<void()> fn) override;
+    void shutdown() override;
+
+    // Whether the job running on this thread should be shed. True at most
+    // once per job: with httplib a job is a whole connection, and only its
+    // first request has waited in the queue.
+    static bool shedCurrent();
+};
+
+// Pre-routing handler answering shed requests with 503 and Retry-After
+httplib::Server::HandlerResponse shed_overload(const httplib::Request &req, httplib::Response &res);
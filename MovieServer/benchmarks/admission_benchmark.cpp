@@ -0,0 +1,177 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <httplib.h>
+#include "../admission.h"
+#include "../task_queue.h"
+#include "../logger.h"
+
+using namespace std;
+using namespace chrono;
+
+// Configuration
+struct Config {
+  size_t workers = 4;           // HTTP worker threads of the server
+  int work_us = 2000;           // time a request handler blocks for, like a database round trip
+  int seconds = 3;              // length of each run
+  int senders = 256;            // client threads sending the schedule
+  bool keepAlive = false;       // senders reuse their connection instead of opening one per request
+  AdmissionConfig admission;
+  vector<double> loads = {0.5, 0.9, 1.2, 2.0};  // offered rate as a multiple of capacity
+};
+
+static double percentile(const vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+struct Result {
+  double rps = 0;               // requests answered 200 per second
+  size_t shed = 0;              // answered 503
+  size_t failed = 0;            // no response at all
+  vector<double> latencies;     // of the 200s
+  vector<double> shedLatencies;
+};
+
+// Serve /work from a server on a free port and send it requests at a fixed
+// rate, one connection per request or over keep-alive connections. With
+// httplib a keep-alive connection holds its worker until the client hangs
+// up, so that is the case shedding has to free workers in. Open loop: the
+// schedule does not slow down when responses do, like independent users.
+// Latency counts from the scheduled send time, so requests that could not
+// even be sent on time are charged for it.
+static Result run_workload(const Config &config, bool admissionControl, double rate) {
+  AdmissionController admission(config.admission);
+  httplib::Server svr;
+  size_t workers = config.workers;
+  svr.new_task_queue = [&, workers]() -> httplib::TaskQueue * {
+    httplib::TaskQueue *queue = new WorkStealingQueue(workers);
+    return admissionControl ? new AdmissionQueue(queue, admission) : queue;
+  };
+  svr.set_pre_routing_handler(shed_overload);
+  int work_us = config.work_us;
+  svr.Get("/work", [work_us](const httplib::Request &, httplib::Response &res) {
+    this_thread::sleep_for(microseconds(work_us));
+    res.set_content("ok", "text/plain");
+  });
+
+  int port = svr.bind_to_any_port("127.0.0.1");
+  thread server([&]() { svr.listen_after_bind(); });
+  svr.wait_until_ready();
+
+  Result result;
+  mutex mtx;
+  size_t total = (size_t)(rate * config.seconds);
+  atomic<size_t> next{0};
+  auto begin = steady_clock::now() + milliseconds(100);
+  vector<thread> threads;
+  for (int c = 0; c < config.senders; c++) {
+    threads.emplace_back([&]() {
+      httplib::Client client("127.0.0.1", port);
+      client.set_keep_alive(config.keepAlive);
+      // A keep-alive connection stuck behind others may never get a
+      // worker; give up on it so the run ends
+      client.set_read_timeout(10, 0);
+      vector<double> ok, shed;
+      size_t failed = 0;
+      for (size_t i = next++; i < total; i = next++) {
+        auto scheduled = begin + duration_cast<steady_clock::duration>(duration<double>(i / rate));
+        this_thread::sleep_until(scheduled);
+        auto res = client.Get("/work");
+        double us = duration<double, micro>(steady_clock::now() - scheduled).count();
+        if (res && res->status == 200) {
+          ok.push_back(us);
+        } else if (res && res->status == 503) {
+          shed.push_back(us);
+        } else {
+          failed++;
+        }
+      }
+      lock_guard<mutex> lock(mtx);
+      result.latencies.insert(result.latencies.end(), ok.begin(), ok.end());
+      result.shedLatencies.insert(result.shedLatencies.end(), shed.begin(), shed.end());
+      result.failed += failed;
+    });
+  }
+
+  for (auto &t : threads) t.join();
+  double secs = duration<double>(steady_clock::now() - begin).count();
+  svr.stop();
+  server.join();
+
+  sort(result.latencies.begin(), result.latencies.end());
+  sort(result.shedLatencies.begin(), result.shedLatencies.end());
+  result.shed = result.shedLatencies.size();
+  result.rps = result.latencies.size() / secs;
+  return result;
+}
+
+void print_usage() {
+  cout << "Usage: ./AdmissionBenchmark [options]\n";
+  cout << "Options:\n";
+  cout << "  --workers <num>     Server worker threads (default: 4)\n";
+  cout << "  --work-us <num>     Handler blocking time per request in microseconds (default: 2000)\n";
+  cout << "  --seconds <num>     Length of each run (default: 3)\n";
+  cout << "  --target-ms <num>   Admission target delay (default: " << ADMISSION_TARGET_MS << ")\n";
+  cout << "  --interval-ms <num> Admission interval (default: " << ADMISSION_INTERVAL_MS << ")\n";
+  cout << "  --keep-alive        Senders keep their connection open between requests\n";
+  cout << "  --help              Show this help message\n";
+}
+
+int main(int argc, char *argv[]) {
+  Config config;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--help") {
+      print_usage();
+      return 0;
+    } else if (arg == "--workers" && i + 1 < argc) {
+      config.workers = stoul(argv[++i]);
+    } else if (arg == "--seconds" && i + 1 < argc) {
+      config.seconds = stoi(argv[++i]);
+    } else if (arg == "--work-us" && i + 1 < argc) {
+      config.work_us = stoi(argv[++i]);
+    } else if (arg == "--target-ms" && i + 1 < argc) {
+      config.admission.target = milliseconds(stoi(argv[++i]));
+    } else if (arg == "--interval-ms" && i + 1 < argc) {
+      config.admission.interval = milliseconds(stoi(argv[++i]));
+    } else if (arg == "--keep-alive") {
+      config.keepAlive = true;
+    }
+  }
+
+  Logger::setLevel(LogLevel::Warn);
+  double capacity = config.workers * 1e6 / config.work_us;
+
+  cout << "========== ADMISSION BENCHMARK ==========\n";
+  cout << "Workers: " << config.workers << ", Capacity: " << capacity << " req/s, Run: " << config.seconds << " s"
+       << ", Handler: " << config.work_us << " us, Target: " << config.admission.target.count() / 1000
+       << " ms, Interval: " << config.admission.interval.count() / 1000 << " ms, Connections: "
+       << (config.keepAlive ? "keep-alive" : "one per request") << "\n";
+  cout << "load: offered rate / capacity. ok/s: 200 responses per second.\n";
+  cout << "Latencies of 200s from their scheduled send time; shed p50 is the same for 503s.\n";
+  cout << "==========================================\n\n";
+  cout << setw(8) << "load" << setw(11) << "admission" << setw(9) << "ok/s" << setw(8) << "shed"
+       << setw(8) << "failed" << setw(11) << "lat p50" << setw(11) << "lat p99" << setw(11) << "lat max"
+       << setw(12) << "shed p50" << "  (us)\n";
+
+  for (double load : config.loads) {
+    for (bool admissionControl : {false, true}) {
+      Result r = run_workload(config, admissionControl, load * capacity);
+      cout << fixed << setprecision(1) << setw(8) << load << setw(11) << (admissionControl ? "codel" : "off")
+           << setprecision(0) << setw(9) << r.rps << setw(8) << r.shed << setw(8) << r.failed
+           << setw(11) << percentile(r.latencies, 0.50) << setw(11) << percentile(r.latencies, 0.99)
+           << setw(11) << (r.latencies.empty() ? 0 : r.latencies.back())
+           << setw(12) << percentile(r.shedLatencies, 0.50) << endl;
+    }
+  }
+
+  return 0;
+}
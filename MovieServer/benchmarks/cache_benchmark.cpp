@@ -0,0 +1,118 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <iomanip>
+#include <string>
+#include "../cache.h"
+#include "../logger.h"
+
+using namespace std;
+using namespace chrono;
+
+// Configuration
+struct Config {
+  size_t capacity = 256 * 1024;   // byte budget, about 1000 of the workload's entries
+  size_t shards = DEFAULT_CACHE_SHARDS;
+  int key_space = 2000;      // distinct keys touched by the workload
+  int ops_per_thread = 200000;
+  double read_ratio = 0.9;   // remaining ops are puts
+  vector<int> thread_counts = {1, 2, 4, 8, 16, 32, 64};
+};
+
+// Run one measurement and return throughput in ops/s
+static double run_workload(Cache &cache, const Config &config, int num_threads) {
+  vector<string> keys;
+  keys.reserve(config.key_space);
+  for (int i = 0; i < config.key_space; i++) keys.push_back("movie:key" + to_string(i));
+  const CacheValue value = make_shared<const string>(100, 'x');
+
+  for (int i = 0; i < config.key_space; i++) cache.put(keys[i], value);
+
+  atomic<bool> start{false};
+  vector<thread> workers;
+  for (int t = 0; t < num_threads; t++) {
+    workers.emplace_back([&, t]() {
+      mt19937 gen(t + 1);
+      uniform_int_distribution<> key_dist(0, config.key_space - 1);
+      uniform_real_distribution<> op_dist(0.0, 1.0);
+      while (!start) this_thread::yield();
+
+      for (int i = 0; i < config.ops_per_thread; i++) {
+        const string &key = keys[key_dist(gen)];
+        if (op_dist(gen) < config.read_ratio) {
+          cache.try_get(key);
+        } else {
+          cache.put(key, value);
+        }
+      }
+    });
+  }
+
+  auto begin = steady_clock::now();
+  start = true;
+  for (auto &worker : workers) worker.join();
+  double secs = duration_cast<duration<double>>(steady_clock::now() - begin).count();
+
+  return (double)num_threads * config.ops_per_thread / secs;
+}
+
+void print_usage() {
+  cout << "Usage: ./CacheBenchmark [options]\n";
+  cout << "Options:\n";
+  cout << "  --capacity <bytes>  Cache byte budget (default: 262144)\n";
+  cout << "  --shards <num>      Shard count of the sharded cache (default: " << DEFAULT_CACHE_SHARDS << ")\n";
+  cout << "  --keys <num>        Distinct keys in the workload (default: 2000)\n";
+  cout << "  --ops <num>         Operations per thread (default: 200000)\n";
+  cout << "  --read-ratio <r>    Fraction of lookups, rest are puts (default: 0.9)\n";
+  cout << "  --help              Show this help message\n";
+}
+
+int main(int argc, char *argv[]) {
+  Config config;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--help") {
+      print_usage();
+      return 0;
+    } else if (arg == "--capacity" && i + 1 < argc) {
+      config.capacity = stoul(argv[++i]);
+    } else if (arg == "--shards" && i + 1 < argc) {
+      config.shards = stoul(argv[++i]);
+    } else if (arg == "--keys" && i + 1 < argc) {
+      config.key_space = stoi(argv[++i]);
+    } else if (arg == "--ops" && i + 1 < argc) {
+      config.ops_per_thread = stoi(argv[++i]);
+    } else if (arg == "--read-ratio" && i + 1 < argc) {
+      config.read_ratio = stod(argv[++i]);
+    }
+  }
+
+  cout << "========== CACHE BENCHMARK ==========\n";
+  cout << "Budget: " << config.capacity << " bytes, Keys: " << config.key_space
+       << ", Ops/thread: " << config.ops_per_thread
+       << ", Read ratio: " << config.read_ratio << "\n";
+  cout << "Baseline: 1 shard (single mutex), Sharded: " << config.shards << " shards\n";
+  cout << "=====================================\n\n";
+  cout << setw(8) << "threads" << setw(18) << "single (ops/s)"
+       << setw(18) << "sharded (ops/s)" << setw(10) << "speedup" << "\n";
+
+  // Keep per-operation cache tracing out of the measurement
+  Logger::setLevel(LogLevel::Off);
+
+  for (int threads : config.thread_counts) {
+    Cache single(config.capacity, 1);
+    double singleOps = run_workload(single, config, threads);
+    Cache sharded(config.capacity, config.shards);
+    double shardedOps = run_workload(sharded, config, threads);
+
+    cout << setw(8) << threads << fixed << setprecision(0)
+         << setw(18) << singleOps << setw(18) << shardedOps
+         << setw(9) << setprecision(2) << shardedOps / singleOps << "x\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <string>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+#include "../cache.h"
+#include "../logger.h"
+
+using namespace std;
+using namespace chrono;
+
+// Count heap traffic of the whole process; the benchmark is single threaded
+// while measuring, so the totals are the cache's own. liveBytes is what
+// the allocator really handed out (including its rounding) minus frees.
+static atomic<size_t> allocCount{0};
+static atomic<size_t> liveBytes{0};
+
+void *operator new(size_t size) {
+  void *p = malloc(size);
+  if (!p) throw bad_alloc();
+  allocCount.fetch_add(1, memory_order_relaxed);
+  liveBytes.fetch_add(malloc_usable_size(p), memory_order_relaxed);
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  if (!p) return;
+  liveBytes.fetch_sub(malloc_usable_size(p), memory_order_relaxed);
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+// Configuration
+struct Config {
+  size_t entries = 100000;
+  size_t ops = 2000000;
+};
+
+// Time ops calls of fn and return ns per call
+template <typename Fn>
+static double ns_per_op(size_t ops, Fn fn) {
+  auto begin = steady_clock::now();
+  for (size_t i = 0; i < ops; i++) fn(i);
+  return (double)duration_cast<nanoseconds>(steady_clock::now() - begin).count() / ops;
+}
+
+int main(int argc, char *argv[]) {
+  Config config;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--entries" && i + 1 < argc) {
+      config.entries = stoul(argv[++i]);
+    } else if (arg == "--ops" && i + 1 < argc) {
+      config.ops = stoul(argv[++i]);
+    } else if (arg == "--help") {
+      cout << "Usage: ./CacheMemoryBenchmark [--entries <num>] [--ops <num>]\n";
+      return 0;
+    }
+  }
+  Logger::setLevel(LogLevel::Off);
+
+  // Keys past the small-string buffer, like real "movie:<title>" keys
+  vector<string> keys, missing;
+  for (size_t i = 0; i < config.entries; i++) {
+    keys.push_back("movie:the movie number " + to_string(i));
+    missing.push_back("movie:no such movie " + to_string(i));
+  }
+  const CacheValue value = make_shared<const string>(100, 'x');
+
+  // Budget far above the footprint so nothing is evicted while filling
+  Cache cache((size_t)4 << 30, DEFAULT_CACHE_SHARDS);
+
+  size_t countBefore = allocCount, bytesBefore = liveBytes;
+  for (const string &key : keys) cache.put(key, value);
+  size_t fillAllocs = allocCount - countBefore;
+  size_t fillBytes = liveBytes - bytesBefore;
+
+  mt19937 gen(1);
+  vector<size_t> order(config.ops);
+  for (size_t &i : order) i = gen() % config.entries;
+
+  double hitNs = ns_per_op(config.ops, [&](size_t i) { cache.try_get(keys[order[i]]); });
+  double missNs = ns_per_op(config.ops, [&](size_t i) { cache.try_get(missing[order[i]]); });
+  double replaceNs = ns_per_op(config.ops, [&](size_t i) { cache.put(keys[order[i]], value); });
+
+  // Steady state of a full cache: every put of a new key evicts one
+  Cache full(cache.bytes(), DEFAULT_CACHE_SHARDS);
+  for (const string &key : keys) full.put(key, value);
+  countBefore = allocCount;
+  double evictNs = ns_per_op(config.entries, [&](size_t i) { full.put(missing[i], value); });
+  double evictAllocs = (double)(allocCount - countBefore) / config.entries;
+
+  cout << "========== CACHE MEMORY BENCHMARK ==========\n";
+  cout << "Entries: " << config.entries << ", Ops: " << config.ops
+       << ", key ~30 bytes, shared 100 byte value\n";
+  cout << "============================================\n\n";
+  cout << fixed << setprecision(1);
+  cout << "heap bytes per entry      " << (double)fillBytes / config.entries << "\n";
+  cout << "allocations per new put   " << (double)fillAllocs / config.entries << "\n";
+  cout << "allocations per evict put " << evictAllocs << "\n";
+  cout << "get hit (ns/op)           " << hitNs << "\n";
+  cout << "get miss (ns/op)          " << missNs << "\n";
+  cout << "put replace (ns/op)       " << replaceNs << "\n";
+  cout << "put with eviction (ns/op) " << evictNs << "\n";
+  return 0;
+}
@@ -0,0 +1,199 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <httplib.h>
+#include "../epoll_server.h"
+#include "../task_queue.h"
+
+using namespace std;
+using namespace chrono;
+
+// Configuration
+struct Config {
+  size_t workers = 8;           // handler threads of either front end
+  size_t reactors = 2;          // epoll event loops
+  int active_clients = 8;       // keep-alive clients sending requests back to back
+  int requests_per_client = 500;
+  int work_us = 50;             // CPU time a request handler spins for
+  vector<int> idle_counts = {0, 16, 64, 256};
+};
+
+static double percentile(const vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+struct Result {
+  double rps = 0;
+  size_t failed = 0;
+  vector<double> latencies;
+};
+
+// Open connections that never send a request, like browsers holding a
+// keep-alive connection between page loads
+static vector<int> open_idle(int port, int count) {
+  vector<int> fds;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  for (int i = 0; i < count; i++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0) {
+      fds.push_back(fd);
+    } else {
+      close(fd);
+    }
+  }
+  return fds;
+}
+
+// Time the active clients' requests while idle connections are held open
+static Result drive(const Config &config, int port, int idle) {
+  vector<int> idleFds = open_idle(port, idle);
+  this_thread::sleep_for(milliseconds(100));  // let the server accept them first
+
+  vector<double> latencies;
+  mutex mtx;
+  atomic<size_t> failed{0};
+  atomic<bool> start{false};
+  vector<thread> threads;
+  for (int c = 0; c < config.active_clients; c++) {
+    threads.emplace_back([&]() {
+      httplib::Client client("127.0.0.1", port);
+      client.set_keep_alive(true);
+      vector<double> mine;
+      while (!start) this_thread::yield();
+      for (int i = 0; i < config.requests_per_client; i++) {
+        auto sent = steady_clock::now();
+        auto res = client.Get("/work");
+        if (res && res->status == 200) {
+          mine.push_back(duration<double, micro>(steady_clock::now() - sent).count());
+        } else {
+          failed++;
+        }
+      }
+      lock_guard<mutex> lock(mtx);
+      latencies.insert(latencies.end(), mine.begin(), mine.end());
+    });
+  }
+
+  auto begin = steady_clock::now();
+  start = true;
+  for (auto &t : threads) t.join();
+  double secs = duration<double>(steady_clock::now() - begin).count();
+  for (int fd : idleFds) close(fd);
+
+  Result result;
+  sort(latencies.begin(), latencies.end());
+  result.latencies = std::move(latencies);
+  result.failed = failed;
+  result.rps = result.latencies.size() / secs;
+  return result;
+}
+
+// Register the same spinning handler on either front end
+template <typename Router>
+static void add_work_route(Router &svr, int work_us) {
+  svr.Get("/work", [work_us](const httplib::Request &, httplib::Response &res) {
+    auto until = steady_clock::now() + microseconds(work_us);
+    while (steady_clock::now() < until) {}
+    res.set_content("ok", "text/plain");
+  });
+}
+
+static Result run_httplib(const Config &config, int idle) {
+  httplib::Server svr;
+  size_t workers = config.workers;
+  svr.new_task_queue = [workers]() -> httplib::TaskQueue * { return new WorkStealingQueue(workers); };
+  svr.set_tcp_nodelay(true);  // as the epoll front end does, else Nagle adds ~40 ms per keep-alive response
+  add_work_route(svr, config.work_us);
+  int port = svr.bind_to_any_port("127.0.0.1");
+  thread server([&]() { svr.listen_after_bind(); });
+  svr.wait_until_ready();
+
+  Result result = drive(config, port, idle);
+  svr.stop();
+  server.join();
+  return result;
+}
+
+static Result run_epoll(const Config &config, int idle, int port) {
+  EpollServer svr(config.reactors, new WorkStealingQueue(config.workers));
+  add_work_route(svr, config.work_us);
+  thread server([&]() { svr.listen("127.0.0.1", port); });
+  this_thread::sleep_for(milliseconds(100));
+
+  Result result = drive(config, port, idle);
+  svr.stop();
+  server.join();
+  return result;
+}
+
+void print_usage() {
+  cout << "Usage: ./FrontendBenchmark [options]\n";
+  cout << "Options:\n";
+  cout << "  --workers <num>     Handler threads (default: 8)\n";
+  cout << "  --reactors <num>    epoll event loops (default: 2)\n";
+  cout << "  --clients <num>     Active keep-alive clients (default: 8)\n";
+  cout << "  --requests <num>    Requests per active client (default: 500)\n";
+  cout << "  --work-us <num>     Handler CPU time per request in microseconds (default: 50)\n";
+  cout << "  --port <num>        Port for the epoll server (default: 18090)\n";
+  cout << "  --help              Show this help message\n";
+}
+
+int main(int argc, char *argv[]) {
+  Config config;
+  int port = 18090;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--help") {
+      print_usage();
+      return 0;
+    } else if (arg == "--workers" && i + 1 < argc) {
+      config.workers = stoul(argv[++i]);
+    } else if (arg == "--reactors" && i + 1 < argc) {
+      config.reactors = stoul(argv[++i]);
+    } else if (arg == "--clients" && i + 1 < argc) {
+      config.active_clients = stoi(argv[++i]);
+    } else if (arg == "--requests" && i + 1 < argc) {
+      config.requests_per_client = stoi(argv[++i]);
+    } else if (arg == "--work-us" && i + 1 < argc) {
+      config.work_us = stoi(argv[++i]);
+    } else if (arg == "--port" && i + 1 < argc) {
+      port = stoi(argv[++i]);
+    }
+  }
+
+  cout << "========== FRONT END BENCHMARK ==========\n";
+  cout << "Workers: " << config.workers << ", Reactors: " << config.reactors
+       << ", Active clients: " << config.active_clients << " x " << config.requests_per_client
+       << " keep-alive requests, Handler: " << config.work_us << " us\n";
+  cout << "Idle: connections opened before the run that never send a request.\n";
+  cout << "=========================================\n\n";
+  cout << setw(6) << "idle" << setw(10) << "frontend" << setw(10) << "req/s" << setw(8) << "failed"
+       << setw(12) << "lat p50" << setw(12) << "lat p99" << setw(12) << "lat max" << "  (us)\n";
+
+  for (int idle : config.idle_counts) {
+    for (bool epoll : {false, true}) {
+      Result r = epoll ? run_epoll(config, idle, port) : run_httplib(config, idle);
+      cout << setw(6) << idle << setw(10) << (epoll ? "epoll" : "httplib") << fixed << setprecision(0)
+           << setw(10) << r.rps << setw(8) << r.failed
+           << setw(12) << percentile(r.latencies, 0.50) << setw(12) << percentile(r.latencies, 0.99)
+           << setw(12) << (r.latencies.empty() ? 0 : r.latencies.back()) << "\n";
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <iomanip>
+#include <string>
+#include <cmath>
+#include "../cache.h"
+#include "../logger.h"
+
+using namespace std;
+
+// Configuration
+struct Config {
+  string trace_file;               // one key per line; synthetic trace if empty
+  size_t requests = 1000000;
+  size_t hot_keys = 50000;         // popular titles, Zipf distributed
+  double zipf_s = 0.9;
+  double one_off_ratio = 0.4;      // share of never-repeated keys (random titles, typos)
+  double list_ratio = 0.002;       // share of full listings
+  size_t title_bytes = 120;        // a one-movie search result
+  size_t catalogue_rows = 2000;    // list_movies is this many rows of title_bytes
+  vector<size_t> budgets_kb = {4096, 8192, 16384, 32768};
+};
+
+// Value size and recompute cost of a key: list_movies is a full scan, the
+// rest are single-title lookups
+static size_t value_bytes(const Config &config, const string &key) {
+  return key == "list_movies" ? config.catalogue_rows * config.title_bytes : config.title_bytes;
+}
+
+static uint32_t value_cost(const Config &config, const string &key) {
+  return key == "list_movies" ? config.catalogue_rows : 1;
+}
+
+// Synthetic trace shaped like the read workload: the list_movies entry, a
+// Zipf-popular set of titles and a stream of one-off search keys
+static vector<string> synthetic_trace(const Config &config) {
+  mt19937 gen(7);
+  vector<double> weights(config.hot_keys);
+  for (size_t i = 0; i < config.hot_keys; i++) weights[i] = 1.0 / pow(i + 1, config.zipf_s);
+  discrete_distribution<size_t> hot_dist(weights.begin(), weights.end());
+  uniform_real_distribution<> coin(0.0, 1.0);
+
+  vector<string> trace;
+  trace.reserve(config.requests);
+  size_t one_off = 0;
+  for (size_t i = 0; i < config.requests; i++) {
+    double c = coin(gen);
+    if (c < config.list_ratio) {
+      trace.push_back("list_movies");
+    } else if (c < config.list_ratio + config.one_off_ratio) {
+      trace.push_back("movie:typo " + to_string(one_off++));
+    } else {
+      trace.push_back("movie:title " + to_string(hot_dist(gen)));
+    }
+  }
+  return trace;
+}
+
+struct ReplayResult {
+  double hit_ratio;
+  double cost_ratio;   // share of recompute cost the hits saved
+};
+
+// Replay the trace as get-or-load against a byte budget
+static ReplayResult replay(const Config &config, const vector<string> &trace,
+                           size_t budget, EvictionPolicyKind kind) {
+  Cache cache(budget, DEFAULT_CACHE_SHARDS, kind);
+  const CacheValue small = make_shared<const string>(config.title_bytes, 'x');
+  const CacheValue large = make_shared<const string>(config.catalogue_rows * config.title_bytes, 'x');
+  size_t hits = 0;
+  double costHit = 0, costTotal = 0;
+  for (const string &key : trace) {
+    uint32_t cost = value_cost(config, key);
+    costTotal += cost;
+    if (cache.try_get(key)) {
+      hits++;
+      costHit += cost;
+    } else {
+      cache.put(key, value_bytes(config, key) == config.title_bytes ? small : large, cost);
+    }
+  }
+  return {(double)hits / trace.size(), costHit / costTotal};
+}
+
+int main(int argc, char *argv[]) {
+  Config config;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--trace" && i + 1 < argc) {
+      config.trace_file = argv[++i];
+    } else if (arg == "--requests" && i + 1 < argc) {
+      config.requests = stoul(argv[++i]);
+    } else if (arg == "--one-off-ratio" && i + 1 < argc) {
+      config.one_off_ratio = stod(argv[++i]);
+    } else if (arg == "--list-ratio" && i + 1 < argc) {
+      config.list_ratio = stod(argv[++i]);
+    } else if (arg == "--help") {
+      cout << "Usage: ./HitRatioBenchmark [--trace <file>] [--requests <num>] [--one-off-ratio <r>]"
+              " [--list-ratio <r>]\n";
+      return 0;
+    }
+  }
+  Logger::setLevel(LogLevel::Off);
+
+  vector<string> trace;
+  if (!config.trace_file.empty()) {
+    ifstream in(config.trace_file);
+    for (string line; getline(in, line);) {
+      if (!line.empty()) trace.push_back(line);
+    }
+  } else {
+    trace = synthetic_trace(config);
+  }
+  if (trace.empty()) {
+    cerr << "Empty trace\n";
+    return 1;
+  }
+
+  cout << "========== HIT RATIO BENCHMARK ==========\n";
+  if (config.trace_file.empty()) {
+    cout << "Synthetic trace: " << trace.size() << " requests, " << config.hot_keys
+         << " Zipf(" << config.zipf_s << ") titles, " << config.one_off_ratio * 100
+         << "% one-off keys, " << config.list_ratio * 100 << "% full listings\n";
+  } else {
+    cout << "Trace: " << config.trace_file << " (" << trace.size() << " requests)\n";
+  }
+  cout << "Values: " << config.title_bytes << " bytes per title, list_movies "
+       << config.catalogue_rows * config.title_bytes / 1024 << " KB costing "
+       << config.catalogue_rows << " lookups\n";
+  cout << "Columns: hit ratio / share of recompute cost saved\n";
+  cout << "=========================================\n\n";
+  cout << setw(11) << "budget (KB)" << setw(20) << "LRU" << setw(20) << "W-TinyLFU"
+       << setw(20) << "GreedyDual" << "\n";
+
+  const EvictionPolicyKind kinds[] = {EvictionPolicyKind::LRU, EvictionPolicyKind::WTinyLFU,
+                                      EvictionPolicyKind::GreedyDual};
+  for (size_t budgetKb : config.budgets_kb) {
+    cout << setw(11) << budgetKb << fixed << setprecision(2);
+    for (EvictionPolicyKind kind : kinds) {
+      ReplayResult r = replay(config, trace, budgetKb * 1024, kind);
+      cout << setw(9) << r.hit_ratio * 100 << "% / " << setw(6) << r.cost_ratio * 100 << "%";
+    }
+    cout << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <cctype>
+#include "../title_index.h"
+
+using namespace std;
+using namespace chrono;
+
+// Configuration
+struct Config {
+  vector<int> row_counts = {10000, 100000, 1000000};
+  int queries = 200;
+};
+
+// Titles shaped like the load generator's: a known title plus a number
+static const vector<string> BASE_TITLES = {
+  "The Shawshank Redemption", "The Godfather", "The Dark Knight",
+  "Pulp Fiction", "Forrest Gump", "Inception", "Fight Club",
+  "The Matrix", "Interstellar", "Gladiator", "The Prestige",
+  "The Departed", "Whiplash", "The Lion King", "Back to the Future",
+  "Spirited Away", "Parasite", "Green Book", "Joker", "1917",
+  "Avengers Endgame", "Spider-Man", "Iron Man", "Batman Begins",
+  "Titanic", "Avatar", "Jurassic Park", "Star Wars", "E.T.",
+  "The Lord of the Rings", "Harry Potter", "The Hobbit"
+};
+
+static string lower(const string &s) {
+  string out = s;
+  transform(out.begin(), out.end(), out.begin(), ::tolower);
+  return out;
+}
+
+// What LOWER(title) LIKE LOWER('%q%') does on a cache miss: fold and test every row
+static size_t full_scan(const vector<string> &titles, const string &query) {
+  string needle = lower(query);
+  size_t matches = 0;
+  for (const string &title : titles) {
+    if (lower(title).find(needle) != string::npos) matches++;
+  }
+  return matches;
+}
+
+int main(int argc, char *argv[]) {
+  Config config;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--queries" && i + 1 < argc) {
+      config.queries = stoi(argv[++i]);
+    } else if (arg == "--help") {
+      cout << "Usage: ./SearchBenchmark [--queries <num>]\n";
+      return 0;
+    }
+  }
+
+  mt19937 gen(42);
+  uniform_int_distribution<> title_dist(0, BASE_TITLES.size() - 1);
+  uniform_int_distribution<> suffix_dist(1000, 9999999);
+
+  // Mix of the generator's hit queries, selective queries and misses
+  vector<string> queries;
+  for (int i = 0; i < config.queries; i++) {
+    switch (i % 4) {
+      case 0: queries.push_back(BASE_TITLES[title_dist(gen)]); break;
+      case 1: queries.push_back(lower(BASE_TITLES[title_dist(gen)]).substr(0, 6)); break;
+      case 2: queries.push_back(to_string(suffix_dist(gen))); break;
+      default: queries.push_back("nonexistent title " + to_string(i)); break;
+    }
+  }
+
+  cout << "========== SEARCH BENCHMARK ==========\n";
+  cout << "Queries per size: " << config.queries << " (hits, prefixes, numeric, misses)\n";
+  cout << "Full scan models LOWER(title) LIKE '%q%' without the MySQL round trip\n";
+  cout << "======================================\n\n";
+  cout << setw(10) << "rows" << setw(14) << "build (ms)" << setw(18) << "scan (us/query)"
+       << setw(18) << "index (us/query)" << setw(10) << "speedup" << "\n";
+
+  for (int rows : config.row_counts) {
+    vector<string> titles;
+    titles.reserve(rows);
+    for (int i = 0; i < rows; i++) {
+      titles.push_back(BASE_TITLES[title_dist(gen)] + " " + to_string(suffix_dist(gen)));
+    }
+
+    auto build_start = steady_clock::now();
+    TitleIndex index;
+    for (int i = 0; i < rows; i++) index.add(i + 1, titles[i]);
+    double build_ms = duration_cast<duration<double, milli>>(steady_clock::now() - build_start).count();
+
+    size_t scan_matches = 0, index_matches = 0;
+    auto scan_start = steady_clock::now();
+    for (const string &q : queries) scan_matches += full_scan(titles, q);
+    double scan_us = duration_cast<duration<double, micro>>(steady_clock::now() - scan_start).count() / queries.size();
+
+    auto index_start = steady_clock::now();
+    for (const string &q : queries) index_matches += index.search(q).size();
+    double index_us = duration_cast<duration<double, micro>>(steady_clock::now() - index_start).count() / queries.size();
+
+    if (scan_matches != index_matches) {
+      cerr << "Result mismatch at " << rows << " rows: scan " << scan_matches
+           << ", index " << index_matches << "\n";
+      return 1;
+    }
+
+    cout << setw(10) << rows << fixed << setprecision(1) << setw(14) << build_ms
+         << setw(18) << scan_us << setw(18) << index_us
+         << setw(9) << setprecision(1) << scan_us / index_us << "x\n";
+  }
+
+  return 0;
+}
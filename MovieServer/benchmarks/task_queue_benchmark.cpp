@@ -0,0 +1,178 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <httplib.h>
+#include "../task_queue.h"
+
+using namespace std;
+using namespace chrono;
+
+// Configuration
+struct Config {
+  size_t workers = 8;           // HTTP worker threads of the server
+  int requests_per_client = 500;
+  int work_us = 50;             // CPU time a request handler spins for
+  bool keep_alive = false;      // reuse client connections (a worker is held per connection)
+  vector<int> client_counts = {8, 16, 32, 64};
+};
+
+// Lock-free sample log, one slot per job, so recording stays out of the
+// way of the queue being measured
+struct Samples {
+  vector<double> us;
+  atomic<size_t> next{0};
+
+  explicit Samples(size_t capacity) : us(capacity) {}
+
+  void add(double value) {
+    size_t i = next.fetch_add(1, memory_order_relaxed);
+    if (i < us.size()) us[i] = value;
+  }
+
+  vector<double> sorted() {
+    vector<double> out(us.begin(), us.begin() + min(next.load(), us.size()));
+    sort(out.begin(), out.end());
+    return out;
+  }
+};
+
+// Task queue wrapper timing each job from enqueue until a worker starts it
+class TimedQueue : public httplib::TaskQueue {
+  private:
+    unique_ptr<httplib::TaskQueue> inner;
+    Samples &waits;
+
+  public:
+    TimedQueue(httplib::TaskQueue *inner, Samples &waits) : inner(inner), waits(waits) {}
+
+    bool enqueue(function<void()> fn) override {
+      auto queued = steady_clock::now();
+      return inner->enqueue([this, queued, fn = std::move(fn)]() {
+        waits.add(duration<double, micro>(steady_clock::now() - queued).count());
+        fn();
+      });
+    }
+
+    void shutdown() override { inner->shutdown(); }
+};
+
+static double percentile(const vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+struct Result {
+  double rps = 0;
+  vector<double> waits;
+  vector<double> latencies;
+};
+
+// Serve /work from a server on a free port and hit it from clients threads
+static Result run_workload(const Config &config, bool stealing, int clients) {
+  size_t total = (size_t)clients * config.requests_per_client;
+  Samples waits(total + clients);
+  Samples latencies(total);
+
+  httplib::Server svr;
+  svr.new_task_queue = [&]() -> httplib::TaskQueue * {
+    httplib::TaskQueue *queue = stealing ? static_cast<httplib::TaskQueue *>(new WorkStealingQueue(config.workers))
+                                         : new httplib::ThreadPool(config.workers);
+    return new TimedQueue(queue, waits);
+  };
+  int work_us = config.work_us;
+  svr.Get("/work", [work_us](const httplib::Request &, httplib::Response &res) {
+    auto until = steady_clock::now() + microseconds(work_us);
+    while (steady_clock::now() < until) {}
+    res.set_content("ok", "text/plain");
+  });
+
+  int port = svr.bind_to_any_port("127.0.0.1");
+  thread server([&]() { svr.listen_after_bind(); });
+  svr.wait_until_ready();
+
+  atomic<bool> start{false};
+  vector<thread> threads;
+  for (int c = 0; c < clients; c++) {
+    threads.emplace_back([&]() {
+      httplib::Client client("127.0.0.1", port);
+      client.set_keep_alive(config.keep_alive);
+      while (!start) this_thread::yield();
+      for (int i = 0; i < config.requests_per_client; i++) {
+        auto sent = steady_clock::now();
+        auto res = client.Get("/work");
+        if (res && res->status == 200) latencies.add(duration<double, micro>(steady_clock::now() - sent).count());
+      }
+    });
+  }
+
+  auto begin = steady_clock::now();
+  start = true;
+  for (auto &t : threads) t.join();
+  double secs = duration<double>(steady_clock::now() - begin).count();
+  svr.stop();
+  server.join();
+
+  Result result;
+  result.latencies = latencies.sorted();
+  result.waits = waits.sorted();
+  result.rps = result.latencies.size() / secs;
+  return result;
+}
+
+void print_usage() {
+  cout << "Usage: ./TaskQueueBenchmark [options]\n";
+  cout << "Options:\n";
+  cout << "  --workers <num>     Server worker threads (default: 8)\n";
+  cout << "  --requests <num>    Requests per client thread (default: 500)\n";
+  cout << "  --work-us <num>     Handler CPU time per request in microseconds (default: 50)\n";
+  cout << "  --keep-alive        Reuse connections instead of one per request\n";
+  cout << "  --help              Show this help message\n";
+}
+
+int main(int argc, char *argv[]) {
+  Config config;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--help") {
+      print_usage();
+      return 0;
+    } else if (arg == "--workers" && i + 1 < argc) {
+      config.workers = stoul(argv[++i]);
+    } else if (arg == "--requests" && i + 1 < argc) {
+      config.requests_per_client = stoi(argv[++i]);
+    } else if (arg == "--work-us" && i + 1 < argc) {
+      config.work_us = stoi(argv[++i]);
+    } else if (arg == "--keep-alive") {
+      config.keep_alive = true;
+    }
+  }
+
+  cout << "========== TASK QUEUE BENCHMARK ==========\n";
+  cout << "Workers: " << config.workers << ", Requests/client: " << config.requests_per_client
+       << ", Handler: " << config.work_us << " us, Connections: "
+       << (config.keep_alive ? "keep-alive" : "one per request") << "\n";
+  cout << "Queue wait: enqueue to worker start. Latency: client round trip.\n";
+  cout << "==========================================\n\n";
+  cout << setw(8) << "clients" << setw(10) << "queue" << setw(10) << "req/s"
+       << setw(12) << "wait p50" << setw(12) << "wait p99" << setw(12) << "lat p50"
+       << setw(12) << "lat p99" << setw(12) << "lat max" << "  (us)\n";
+
+  for (int clients : config.client_counts) {
+    for (bool stealing : {false, true}) {
+      Result r = run_workload(config, stealing, clients);
+      cout << setw(8) << clients << setw(10) << (stealing ? "stealing" : "pool") << fixed << setprecision(0)
+           << setw(10) << r.rps
+           << setw(12) << percentile(r.waits, 0.50) << setw(12) << percentile(r.waits, 0.99)
+           << setw(12) << percentile(r.latencies, 0.50) << setw(12) << percentile(r.latencies, 0.99)
+           << setw(12) << (r.latencies.empty() ? 0 : r.latencies.back()) << "\n";
+    }
+  }
+
+  return 0;
+}
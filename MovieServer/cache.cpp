@@ -1,81 +1,720 @@
 #include "cache.h"
+#include "logger.h"
+
+using Clock = chrono::steady_clock;
+
+// Start the refresh thread
+CacheRefresher::CacheRefresher() : worker(&CacheRefresher::run, this) {}
+
+// Stop the refresh thread, refreshes not started yet are dropped
+CacheRefresher::~CacheRefresher() {
+  {
+    lock_guard<mutex> lock(mtx);
+    stopping = true;
+  }
+  cv.notify_one();
+  worker.join();
+}
+
+// Queue a refresh
+void CacheRefresher::post(function<void()> task) {
+  {
+    lock_guard<mutex> lock(mtx);
+    tasks.push_back(std::move(task));
+  }
+  cv.notify_one();
+}
+
+// Run queued refreshes one at a time until stopped. A refresh that throws
+// is dropped, and the stale value stays in place for the next read to retry.
+void CacheRefresher::run() {
+  unique_lock<mutex> lock(mtx);
+  while (true) {
+    cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+    if (stopping) return;
+    function<void()> task = std::move(tasks.front());
+    tasks.pop_front();
+    lock.unlock();
+    try {
+      task();
+    } catch (const exception &e) {
+      LOG_WARN("Background refresh failed: %s", e.what());
+    } catch (...) {
+      LOG_WARN("Background refresh failed");
+    }
+    lock.lock();
+  }
+}
+
+// Whether an entry is past its stale window, checking the clock only for
+// entries that have one
+static bool is_expired(const CacheEntry *e) {
+  return e->expiresAt != Clock::time_point::max() && Clock::now() >= e->expiresAt;
+}
+
+// Whether an entry is served stale (marked stale or past its ttl)
+static bool is_stale(const CacheEntry *e) {
+  return e->freshUntil != Clock::time_point::max() &&
+         (e->freshUntil == Clock::time_point::min() || Clock::now() >= e->freshUntil);
+}
+
+#define CACHE_INDEX_MIN_SLOTS 16
+#define CACHE_ENTRY_CHUNK_MAX 1024
+
+CacheIndex::CacheIndex() : slots(CACHE_INDEX_MIN_SLOTS, Slot{0, nullptr}), mask(CACHE_INDEX_MIN_SLOTS - 1) {}
+
+// Probe from the key's home slot until the key or an empty slot is found
+CacheEntry *CacheIndex::find(const string &key, uint64_t hash) const {
+  for (size_t i = hash & mask; slots[i].entry; i = (i + 1) & mask) {
+    if (slots[i].hash == hash && slots[i].entry->key == key) return slots[i].entry;
+  }
+  return nullptr;
+}
+
+// Slot holding an indexed entry
+size_t CacheIndex::slotOf(const CacheEntry *e) const {
+  size_t i = e->hash & mask;
+  while (slots[i].entry != e) i = (i + 1) & mask;
+  return i;
+}
+
+// Put an entry into the first free slot from its home slot
+void CacheIndex::place(uint64_t hash, CacheEntry *e) {
+  size_t i = hash & mask;
+  while (slots[i].entry) i = (i + 1) & mask;
+  slots[i] = Slot{hash, e};
+}
+
+// Double the table, keeping the load factor at most 3/4
+void CacheIndex::grow() {
+  vector<Slot> old(slots.size() * 2, Slot{0, nullptr});
+  old.swap(slots);
+  mask = slots.size() - 1;
+  for (const Slot &slot : old) {
+    if (slot.entry) place(slot.hash, slot.entry);
+  }
+}
+
+// Take a recycled entry, or carve a new chunk (as large as the index so
+// far, up to CACHE_ENTRY_CHUNK_MAX entries) when none is free
+CacheEntry *CacheIndex::allocate() {
+  if (!freeList) {
+    size_t chunkSize = max<size_t>(16, min<size_t>(CACHE_ENTRY_CHUNK_MAX, count));
+    chunks.push_back(make_unique<CacheEntry[]>(chunkSize));
+    CacheEntry *chunk = chunks.back().get();
+    for (size_t i = 0; i < chunkSize; i++) {
+      chunk[i].next = freeList;
+      freeList = &chunk[i];
+    }
+  }
+  CacheEntry *e = freeList;
+  freeList = e->next;
+  e->next = nullptr;
+  return e;
+}
+
+// Reset an entry to its defaults and put it on the free list, keeping the
+// key's buffer for the next key
+static void recycle_entry(CacheEntry *e, CacheEntry *&freeList) {
+  string key = std::move(e->key);
+  key.clear();
+  *e = CacheEntry();
+  e->key = std::move(key);
+  e->next = freeList;
+  freeList = e;
+}
+
+// Index a new entry for key (which must not be present) and return it
+CacheEntry *CacheIndex::insert(const string &key, uint64_t hash) {
+  if ((count + 1) * 4 > slots.size() * 3) grow();
+  CacheEntry *e = allocate();
+  e->key.assign(key);
+  e->hash = hash;
+  place(hash, e);
+  count++;
+  return e;
+}
+
+// Unindex an entry and recycle it. Later slots of the probe run are
+// shifted back so lookups never stop early at the hole.
+void CacheIndex::remove(CacheEntry *e) {
+  size_t hole = slotOf(e);
+  for (size_t j = (hole + 1) & mask; slots[j].entry; j = (j + 1) & mask) {
+    // slots[j] may fill the hole unless its home lies cyclically in (hole, j]
+    size_t home = slots[j].hash & mask;
+    bool homeAfterHole = hole <= j ? (home > hole && home <= j) : (home > hole || home <= j);
+    if (!homeAfterHole) {
+      slots[hole] = slots[j];
+      hole = j;
+    }
+  }
+  slots[hole] = Slot{0, nullptr};
+  count--;
+  recycle_entry(e, freeList);
+}
+
+// Recycle every entry
+void CacheIndex::clear() {
+  for (Slot &slot : slots) {
+    if (slot.entry) recycle_entry(slot.entry, freeList);
+    slot = Slot{0, nullptr};
+  }
+  count = 0;
+}
+
+// Take bytes from the pool if it has that many left
+bool CacheLargePool::borrow(size_t bytes) {
+  size_t left = available.load(memory_order_relaxed);
+  do {
+    if (left < bytes) return false;
+  } while (!available.compare_exchange_weak(left, left - bytes, memory_order_relaxed));
+  return true;
+}
+
+// Give bytes back to the pool
+void CacheLargePool::repay(size_t bytes) {
+  available.fetch_add(bytes, memory_order_relaxed);
+}
 
 // Constructor
-Cache::Cache(size_t cap) : capacity(cap) {}
+CacheShard::CacheShard(size_t budget, EvictionPolicyKind policyKind, CacheLargePool &largePool,
+                       CacheRefresher &refresher, atomic<uint64_t> &versions)
+    : budgetBytes(budget), largePool(largePool), policy(make_eviction_policy(policyKind, budget)),
+      refresher(refresher), versions(versions) {}
 
-// Check whether key present in cache or not
-bool Cache::exists(const string &key) {
+// The version to store a value under: the caller's, or a new unique one
+uint64_t CacheShard::resolveVersion(uint64_t version) {
+  if (version) return version;
+  return CACHE_AUTO_VERSION | (versions.fetch_add(1, memory_order_relaxed) + 1);
+}
+
+// Find an entry, dropping it if it has expired (lock held)
+CacheEntry *CacheShard::findLive(const string &key, uint64_t hash) {
+  CacheEntry *e = index.find(key, hash);
+  if (!e) return nullptr;
+  if (is_expired(e)) {
+    LOG_TRACE("Cache entry expired: %s", key.c_str());
+    removeEntry(e);
+    return nullptr;
+  }
+  return e;
+}
+
+// Check whether key present in shard or not
+bool CacheShard::exists(const string &key, uint64_t hash) {
   lock_guard<mutex> lock(mtx);
-  return cacheMap.find(key) != cacheMap.end();
+  return findLive(key, hash) != nullptr;
 }
 
-// Get data from cache
-string Cache::get(const string &key) {
+// Look up and fetch data under a single lock acquisition, nullptr on miss.
+// A stale value is returned as is, refreshing it is up to get_or_load().
+CacheValue CacheShard::try_get(const string &key, uint64_t hash) {
+  lock_guard<mutex> lock(mtx);
+  CacheEntry *e = findLive(key, hash);
+  if (!e) {
+    policy->onMiss(hash);
+    LOG_TRACE("Cache miss for: %s", key.c_str());
+    return nullptr;
+  }
+
+  policy->onAccess(e);
+  LOG_TRACE("Cache hit for: %s", key.c_str());
+  return e->value;
+}
+
+// Put data into shard
+void CacheShard::put(const string &key, uint64_t hash, CacheValue value, uint32_t cost, CacheExpiry expiry,
+                     CacheTags tags, uint64_t version) {
   lock_guard<mutex> lock(mtx);
-  auto it = cacheMap.find(key);
-  if (it == cacheMap.end()) {
-    cout << "Cache miss for: " << key << endl;
-    return "";
+  insertEntry(key, hash, std::move(value), cost, expiry, std::move(tags), resolveVersion(version));
+}
+
+// Insert or replace an entry and evict down to the budget (lock held)
+void CacheShard::insertEntry(const string &key, uint64_t hash, CacheValue value, uint32_t cost,
+                             CacheExpiry expiry, CacheTags tags, uint64_t version) {
+  size_t charge = cache_entry_charge(key, value, tags);
+  CacheEntry *e = index.find(key, hash);
+  if (e) repay(e);
+  bool large = charge > budgetBytes;
+  if (large) {
+    // Would evict the whole shard, so it is charged to the large-entry
+    // pool; without room there, drop any older value rather than keep it
+    if (!largePool.borrow(charge)) {
+      if (e) removeEntry(e);
+      loadStats.rejected++;
+      LOG_DEBUG("Not caching %s: %zu bytes exceeds shard budget and large-entry pool", key.c_str(), charge);
+      return;
+    }
+    borrowedBytes += charge;
   }
 
-  // it is iterator to cacheMap, it->second.second is iterator to LRUlist
-  string value = it->second.first;
+  if (e) {
+    // Key already exists in cache: new size and cost, same place in the policy
+    untag(e);
+    usedBytes -= e->charge;
+    e->value = std::move(value);
+    for (CacheValue &encoded : e->variants) encoded.reset();
+    e->encoding = 0;
+    policy->onResize(e, charge, cost);
+  } else {
+    // Insert new key
+    e = index.insert(key, hash);
+    e->value = std::move(value);
+    e->charge = charge;
+    e->cost = cost;
+    policy->onInsert(e);
+    LOG_TRACE("Put into cache: %s", key.c_str());
+  }
+  usedBytes += charge;
+  e->large = large;
+  e->version = version;
+  e->tags = std::move(tags);
+  for (uint64_t tag : e->tags) tagged[tag].insert(e);
+
+  if (expiry.ttl.count() > 0) {
+    Clock::time_point now = Clock::now();
+    e->freshUntil = now + expiry.ttl;
+    e->expiresAt = e->freshUntil + expiry.staleFor;
+  } else {
+    e->freshUntil = Clock::time_point::max();
+    e->expiresAt = Clock::time_point::max();
+  }
+
+  evictOverBudget();
+}
+
+// Evict until the shard is within its budget (lock held)
+void CacheShard::evictOverBudget() {
+  // Other shards' loans shrink this budget too; the shard catches up on
+  // its next insert
+  while (usedBytes + largePool.shardShare() > budgetBytes + borrowedBytes) {
+    // Shard over budget, the policy picks what goes (possibly the new entry)
+    CacheEntry *victim = policy->victim();
+    LOG_DEBUG("Key: %s evicted from cache", victim->key.c_str());
+    removeEntry(victim);
+  }
+}
+
+// Return the cached value, or load it once however many callers miss on
+// the key at the same time. A stale value is returned immediately and one
+// background refresh is started for it. version, if given, receives the
+// returned value's version (0 for a value the loader marked uncacheable).
+CacheValue CacheShard::get_or_load(const string &key, uint64_t hash, const CacheLoader &loader,
+                                   uint32_t cost, CacheExpiry expiry, uint64_t *version) {
+  shared_ptr<Flight> flight;
+  shared_ptr<Flight> pending;
+  {
+    lock_guard<mutex> lock(mtx);
+    CacheEntry *e = findLive(key, hash);
+    if (e) {
+      policy->onAccess(e);
+      if (version) *version = e->version;
+      if (!is_stale(e)) {
+        LOG_TRACE("Cache hit for: %s", key.c_str());
+        return e->value;
+      }
+
+      loadStats.staleHits++;
+      if (inflight.find(key) == inflight.end()) {
+        auto refresh = make_shared<Flight>();
+        inflight.emplace(key, refresh);
+        loadStats.loads++;
+        loadStats.refreshes++;
+        LOG_TRACE("Cache hit for: %s, stale, refreshing", key.c_str());
+        refresher.post([this, key, hash, refresh, loader, cost, expiry]() {
+          runLoad(key, hash, refresh, loader, cost, expiry, nullptr);
+        });
+      }
+      return e->value;
+    }
+    policy->onMiss(hash);
 
-  LRUlist.erase(it->second.second);
-  LRUlist.push_front(key);
-  it->second.second = LRUlist.begin();
-  cout << "Cache hit for: " << key << endl;
+    auto running = inflight.find(key);
+    if (running != inflight.end()) {
+      pending = running->second;
+      loadStats.coalesced++;
+    } else {
+      flight = make_shared<Flight>();
+      inflight.emplace(key, flight);
+      loadStats.loads++;
+    }
+  }
+
+  if (!flight) {
+    LOG_TRACE("Cache miss for: %s, waiting on load in flight", key.c_str());
+    CacheValue value = pending->result.get();
+    if (version) *version = pending->version;
+    return value;
+  }
+
+  LOG_TRACE("Cache miss for: %s, loading", key.c_str());
+  return runLoad(key, hash, flight, loader, cost, expiry, version);
+}
+
+// Run a loader for the flight registered on key and publish its result
+CacheValue CacheShard::runLoad(const string &key, uint64_t hash, const shared_ptr<Flight> &flight,
+                               const CacheLoader &loader, uint32_t cost, CacheExpiry expiry,
+                               uint64_t *version) {
+  CacheValue value;
+  CacheTags tags;
+  uint64_t loadedVersion = 0;
+  bool cacheable = false;
+  try {
+    cacheable = loader(value, tags, loadedVersion);
+  } catch (...) {
+    // Waiters rethrow the loader's exception rather than get no value
+    {
+      lock_guard<mutex> lock(mtx);
+      inflight.erase(key);
+    }
+    flight->done.set_exception(current_exception());
+    throw;
+  }
+  finishLoad(key, hash, flight, value, cacheable, cost, expiry, std::move(tags), loadedVersion);
+  if (version) *version = flight->version;
   return value;
 }
 
-// Put data into cache
-void Cache::put(const string &key, const string &value) {
+// Publish a load's result to the cache and to its waiters. A failed
+// refresh leaves the stale value in place for the next read to retry.
+void CacheShard::finishLoad(const string &key, uint64_t hash, const shared_ptr<Flight> &flight,
+                            CacheValue value, bool cacheable, uint32_t cost, CacheExpiry expiry,
+                            CacheTags tags, uint64_t version) {
+  {
+    lock_guard<mutex> lock(mtx);
+    inflight.erase(key);
+    if (cacheable && value) {
+      // The version identifies the value even if it is not kept
+      flight->version = resolveVersion(version);
+      if (!flight->invalidated) insertEntry(key, hash, value, cost, expiry, std::move(tags), flight->version);
+    }
+  }
+  flight->done.set_value(std::move(value));
+}
+
+// End an entry's freshness now: it keeps being served until a refresh
+// replaces it or its stale window runs out. A load already in flight was
+// computed from older data and is not cached.
+void CacheShard::markStale(const string &key, uint64_t hash) {
   lock_guard<mutex> lock(mtx);
+  auto running = inflight.find(key);
+  if (running != inflight.end()) running->second->invalidated = true;
 
-  auto it = cacheMap.find(key);
-  if (it != cacheMap.end()) {
-    // Key already exists in cache
-    it->second.first = value;
-    LRUlist.erase(it->second.second);
-    LRUlist.push_front(key);
-    it->second.second = LRUlist.begin();
-    return;
+  CacheEntry *e = index.find(key, hash);
+  if (!e) return;
+  e->freshUntil = Clock::time_point::min();
+  LOG_TRACE("Marked stale in cache: %s", key.c_str());
+}
+
+// Unlink an entry from the policy and its tags and free it (lock held)
+void CacheShard::removeEntry(CacheEntry *e) {
+  repay(e);
+  policy->onRemove(e);
+  untag(e);
+  usedBytes -= e->charge;
+  index.remove(e);
+}
+
+// Give a large entry's charge back to the pool (lock held)
+void CacheShard::repay(CacheEntry *e) {
+  if (!e->large) return;
+  largePool.repay(e->charge);
+  borrowedBytes -= e->charge;
+  e->large = false;
+}
+
+// Make room for an entry to grow by bytes: a large entry borrows them, and
+// one that grows past the shard's budget moves to the pool. Returns false
+// if the pool cannot take it (lock held).
+bool CacheShard::grow(CacheEntry *e, size_t bytes) {
+  if (e->large) {
+    if (!largePool.borrow(bytes)) return false;
+    borrowedBytes += bytes;
+    return true;
+  }
+  size_t charge = e->charge + bytes;
+  if (charge <= budgetBytes) return true;
+  if (!largePool.borrow(charge)) return false;
+  borrowedBytes += charge;
+  e->large = true;
+  return true;
+}
+
+// Drop an entry from the tag map (lock held)
+void CacheShard::untag(CacheEntry *e) {
+  for (uint64_t tag : e->tags) {
+    auto entries = tagged.find(tag);
+    if (entries == tagged.end()) continue;
+    entries->second.erase(e);
+    if (entries->second.empty()) tagged.erase(entries);
+  }
+  e->tags.clear();
+}
+
+// Remove key from shard, and keep a load in flight from caching a value
+// computed before the removal
+void CacheShard::erase(const string &key, uint64_t hash) {
+  lock_guard<mutex> lock(mtx);
+  auto running = inflight.find(key);
+  if (running != inflight.end()) running->second->invalidated = true;
+
+  CacheEntry *e = index.find(key, hash);
+  if (!e) return;
+  removeEntry(e);
+  LOG_TRACE("Removed from cache: %s", key.c_str());
+}
+
+// Remove the entries carrying tag whose key passes match. A load in
+// flight may depend on the tag too, since its tags are not known yet, so
+// one whose key passes match is not cached. Keys are matched outside the
+// lock; a load that finished meanwhile has its entry removed instead.
+// With no match, every tagged entry and every load in flight is hit.
+// Returns how many entries were removed.
+size_t CacheShard::invalidateTag(uint64_t tag, const function<bool(const string &)> &match) {
+  vector<string> keys;
+  {
+    lock_guard<mutex> lock(mtx);
+    auto entries = tagged.find(tag);
+    if (!match) {
+      for (auto &running : inflight) running.second->invalidated = true;
+      if (entries == tagged.end()) return 0;
+      vector<CacheEntry *> victims(entries->second.begin(), entries->second.end());
+      for (CacheEntry *e : victims) removeEntry(e);
+      loadStats.invalidations += victims.size();
+      return victims.size();
+    }
+    for (auto &running : inflight) keys.push_back(running.first);
+    if (entries != tagged.end()) {
+      for (CacheEntry *e : entries->second) keys.push_back(e->key);
+    }
+  }
+  if (keys.empty()) return 0;
+
+  keys.erase(remove_if(keys.begin(), keys.end(), [&match](const string &key) { return !match(key); }),
+             keys.end());
+  if (keys.empty()) return 0;
+
+  lock_guard<mutex> lock(mtx);
+  size_t removed = 0;
+  for (const string &key : keys) {
+    auto running = inflight.find(key);
+    if (running != inflight.end()) running->second->invalidated = true;
+    CacheEntry *e = index.find(key, hash<string>()(key));
+    if (!e) continue;
+    LOG_TRACE("Invalidated in cache: %s", key.c_str());
+    removeEntry(e);
+    removed++;
   }
+  loadStats.invalidations += removed;
+  return removed;
+}
+
+// Return the encoded form in slot of key's value, building it on first
+// use. value is the one the caller was served. If the key does not hold
+// it (the value was not cached, or was replaced since), the form is built
+// for this caller only. nullptr is returned while another caller is
+// building the form, so the caller falls back to value itself.
+CacheValue CacheShard::variant(const string &key, uint64_t hash, const CacheValue &value, size_t slot,
+                               const CacheEncoder &encode) {
+  uint8_t flag = static_cast<uint8_t>(1u << slot);
+  bool cached = false;
+  {
+    lock_guard<mutex> lock(mtx);
+    CacheEntry *e = index.find(key, hash);
+    if (e && e->value == value) {
+      if (e->variants[slot]) return e->variants[slot];
+      if (e->encoding & flag) return nullptr;
+      e->encoding |= flag;
+      cached = true;
+    }
+  }
+
+  // Encode outside the lock, the value is immutable
+  CacheValue encoded;
+  try {
+    encoded = encode(*value);
+  } catch (...) {
+    encoded = nullptr;
+  }
+  if (!cached) return encoded;
+
+  lock_guard<mutex> lock(mtx);
+  CacheEntry *e = index.find(key, hash);
+  if (!e || e->value != value) return encoded;
+  e->encoding &= static_cast<uint8_t>(~flag);
+  if (!encoded) return nullptr;
+  if (!grow(e, encoded->size())) {
+    // No room to keep it, but this response can still use it
+    loadStats.rejected++;
+    return encoded;
+  }
+
+  // Grown in place, a hit must not demote the entry or count as a use
+  e->variants[slot] = encoded;
+  policy->onResize(e, e->charge + encoded->size(), e->cost);
+  usedBytes += encoded->size();
+  evictOverBudget();
+  return encoded;
+}
+
+// Clear shard
+void CacheShard::clear() {
+  lock_guard<mutex> lock(mtx);
+  for (auto &running : inflight) running.second->invalidated = true;
+  policy->clear();
+  tagged.clear();
+  index.clear();
+  usedBytes = 0;
+  largePool.repay(borrowedBytes);
+  borrowedBytes = 0;
+}
+
+// Get number of items stored in shard
+size_t CacheShard::size() const {
+  lock_guard<mutex> lock(mtx);
+  return index.size();
+}
+
+// Get bytes charged to the shard
+size_t CacheShard::bytes() const {
+  lock_guard<mutex> lock(mtx);
+  return usedBytes;
+}
+
+// Get read-through counters of the shard
+CacheLoadStats CacheShard::stats() const {
+  lock_guard<mutex> lock(mtx);
+  return loadStats;
+}
+
+// Constructor: split the byte budget evenly across shards
+Cache::Cache(size_t budget, size_t numShards, EvictionPolicyKind policyKind)
+    : budgetBytes(budget), largePool(budget / 100 * CACHE_LARGE_ENTRY_PERCENT, max<size_t>(numShards, 1)) {
+  if (numShards == 0) numShards = 1;
 
-  if (cacheMap.size() >= capacity) {
-    // Cache full, evict
-    string leastUsed = LRUlist.back();
-    LRUlist.pop_back();
-    cacheMap.erase(leastUsed);
-    cout << "Key: " << leastUsed << " evicted from cache" << endl;
+  size_t shardBudget = budget / numShards;
+  shards.reserve(numShards);
+  for (size_t i = 0; i < numShards; i++) {
+    shards.push_back(make_unique<CacheShard>(shardBudget, policyKind, largePool, refresher, versions));
   }
+}
+
+// Pick the shard owning a key hash (high bits, the low bits feed the
+// shard's own table)
+CacheShard &Cache::shardFor(uint64_t hash) {
+  return *shards[(hash >> 32) % shards.size()];
+}
+
+// Check whether key present in cache or not
+bool Cache::exists(const string &key) {
+  uint64_t hash = hasher(key);
+  return shardFor(hash).exists(key, hash);
+}
+
+// Get data from cache
+string Cache::get(const string &key) {
+  CacheValue value = try_get(key);
+  return value ? *value : "";
+}
+
+// Look up and fetch data from cache in one probe, nullptr on miss
+CacheValue Cache::try_get(const string &key) {
+  uint64_t hash = hasher(key);
+  return shardFor(hash).try_get(key, hash);
+}
+
+// Put a shared buffer into cache
+void Cache::put(const string &key, CacheValue value, uint32_t cost, CacheExpiry expiry, CacheTags tags,
+                uint64_t version) {
+  uint64_t hash = hasher(key);
+  shardFor(hash).put(key, hash, std::move(value), cost, expiry, std::move(tags), version);
+}
+
+// Put data into cache, taking ownership of the string
+void Cache::put(const string &key, string value, uint32_t cost, CacheExpiry expiry, CacheTags tags,
+                uint64_t version) {
+  put(key, make_shared<const string>(std::move(value)), cost, expiry, std::move(tags), version);
+}
 
-  // Insert new key
-  LRUlist.push_front(key);
-  cacheMap[key] = make_pair(value, LRUlist.begin());
-  cout << "Put into cache: " << key << endl;
+// Get data from cache, loading it on a miss (see CacheShard::get_or_load)
+CacheValue Cache::get_or_load(const string &key, const CacheLoader &loader, uint32_t cost, CacheExpiry expiry,
+                              uint64_t *version) {
+  uint64_t hash = hasher(key);
+  return shardFor(hash).get_or_load(key, hash, loader, cost, expiry, version);
+}
+
+// Serve key stale until it is refreshed (see CacheShard::markStale)
+void Cache::markStale(const string &key) {
+  uint64_t hash = hasher(key);
+  shardFor(hash).markStale(key, hash);
 }
 
 // Remove key from cache
 void Cache::erase(const string &key) {
-  lock_guard<mutex> lock(mtx);
-  auto it = cacheMap.find(key);
-  if (it == cacheMap.end()) return;
-  LRUlist.erase(it->second.second);
-  cacheMap.erase(it);
-  cout << "Removed from cache: " << key << endl;
+  uint64_t hash = hasher(key);
+  shardFor(hash).erase(key, hash);
+}
+
+// Remove the entries depending on tag from every shard (see
+// CacheShard::invalidateTag), returning how many there were
+size_t Cache::invalidateTag(uint64_t tag, const function<bool(const string &)> &match) {
+  size_t removed = 0;
+  for (auto &shard : shards) removed += shard->invalidateTag(tag, match);
+  return removed;
+}
+
+// Get an encoded form of key's value (see CacheShard::variant)
+CacheValue Cache::variant(const string &key, const CacheValue &value, size_t slot, const CacheEncoder &encode) {
+  uint64_t hash = hasher(key);
+  return shardFor(hash).variant(key, hash, value, slot, encode);
 }
 
 // Clear cache
 void Cache::clear() {
-  lock_guard<mutex> lock(mtx);
-  cacheMap.clear();
-  LRUlist.clear();
-  cout << "Cache cleared" << endl;
+  for (auto &shard : shards) shard->clear();
+  LOG_DEBUG("Cache cleared");
 }
 
 // Get number of items stored in cache
 size_t Cache::size() const {
-  lock_guard<mutex> lock(mtx);
-  return cacheMap.size();
+  size_t total = 0;
+  for (const auto &shard : shards) total += shard->size();
+  return total;
+}
+
+// Get bytes charged to the cache (keys, values and bookkeeping)
+size_t Cache::bytes() const {
+  size_t total = 0;
+  for (const auto &shard : shards) total += shard->bytes();
+  return total;
+}
+
+// Get the configured byte budget
+size_t Cache::budget() const {
+  return budgetBytes;
+}
+
+// Get bytes of large entries charged to the large-entry pool
+size_t Cache::largeBytes() const {
+  return largePool.used();
+}
+
+// Get number of independently locked shards
+size_t Cache::shardCount() const {
+  return shards.size();
+}
+
+// Get read-through counters summed over the shards
+CacheLoadStats Cache::loadStats() const {
+  CacheLoadStats total;
+  for (const auto &shard : shards) {
+    CacheLoadStats s = shard->stats();
+    total.loads += s.loads;
+    total.coalesced += s.coalesced;
+    total.refreshes += s.refreshes;
+    total.staleHits += s.staleHits;
+    total.invalidations += s.invalidations;
+    total.rejected += s.rejected;
+  }
+  return total;
 }
@@ -1,27 +1,276 @@
 #pragma once
 #include <iostream>
 #include <unordered_map>
-#include <list>
+#include <unordered_set>
 #include <string>
 #include <utility>
 #include <mutex>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include "cache_policy.h"
 
 using namespace std;
 
-class Cache {
+#define DEFAULT_CACHE_SHARDS 16
+#define DEFAULT_CACHE_BUDGET_BYTES (64 * 1024 * 1024)
+
+// Share of the budget that values larger than a shard's share may take
+#define CACHE_LARGE_ENTRY_PERCENT 25
+
+// Set in versions the cache assigns itself, so they never collide with
+// versions supplied by callers
+#define CACHE_AUTO_VERSION (1ULL << 63)
+
+// Computes the value for a missing key, the tags it depends on and
+// optionally its version (left 0, the cache assigns one). Returns whether
+// the value may be cached; either way it is handed to every caller
+// waiting on the load.
+using CacheLoader = function<bool(CacheValue &value, CacheTags &tags, uint64_t &version)>;
+
+// Builds an encoded form of a cached value, nullptr if it cannot
+using CacheEncoder = function<CacheValue(const string &value)>;
+
+// How long a value stays fresh, and how much longer it may be served
+// stale while one background refresh recomputes it. A zero ttl never
+// expires (the entry can still be marked stale).
+struct CacheExpiry {
+  chrono::milliseconds ttl{0};
+  chrono::milliseconds staleFor{0};
+};
+
+// Read-through counters: loads ran the loader (refreshes among them in the
+// background), coalesced callers waited on a load already in flight
+// instead of running their own, staleHits were served a stale value,
+// invalidations are entries dropped by invalidateTag(), rejected values
+// too large to cache even with the large-entry pool
+struct CacheLoadStats {
+  size_t loads = 0;
+  size_t coalesced = 0;
+  size_t refreshes = 0;
+  size_t staleHits = 0;
+  size_t invalidations = 0;
+  size_t rejected = 0;
+};
+
+// Lends the whole cache's budget to values larger than one shard's share,
+// such as a full listing, up to capacity bytes. A shard holding one
+// borrows its whole charge on top of its own budget and repays it when the
+// entry goes. What is lent is taken from every shard alike: each one's
+// budget shrinks by its part of the loan, so nothing is set aside while no
+// large value is cached.
+class CacheLargePool {
   private:
     size_t capacity;
-    list<string> LRUlist; // stores keys
-    unordered_map<string, pair<string, list<string>::iterator>> cacheMap;
+    size_t shards;
+    atomic<size_t> available;
+
+  public:
+    CacheLargePool(size_t capacity, size_t shards) : capacity(capacity), shards(shards), available(capacity) {}
+
+    bool borrow(size_t bytes);
+    void repay(size_t bytes);
+    size_t used() const { return capacity - available.load(memory_order_relaxed); }
+    size_t shardShare() const { return used() / shards; }
+};
+
+// Background thread running stale-while-revalidate refreshes in order
+class CacheRefresher {
+  private:
+    mutex mtx;
+    condition_variable cv;
+    deque<function<void()>> tasks;
+    bool stopping = false;
+    thread worker;
+
+    void run();
+
+  public:
+    CacheRefresher();
+    ~CacheRefresher();
+
+    void post(function<void()> task);
+};
+
+// Flat open-addressing index of a shard's entries. Slots hold the key hash
+// next to the entry pointer, so probing compares hashes in one contiguous
+// array and touches an entry only on a likely match. Entries come from
+// chunked storage and freed ones are recycled, key buffer included, so
+// steady-state puts do not allocate. Not thread-safe, the shard locks.
+class CacheIndex {
+  private:
+    struct Slot {
+      uint64_t hash;
+      CacheEntry *entry;  // nullptr = empty
+    };
+
+    vector<Slot> slots;
+    size_t mask = 0;
+    size_t count = 0;
+    vector<unique_ptr<CacheEntry[]>> chunks;
+    CacheEntry *freeList = nullptr;  // threaded through CacheEntry::next
+
+    size_t slotOf(const CacheEntry *e) const;
+    void place(uint64_t hash, CacheEntry *e);
+    void grow();
+    CacheEntry *allocate();
+
+  public:
+    CacheIndex();
+
+    CacheEntry *find(const string &key, uint64_t hash) const;
+    CacheEntry *insert(const string &key, uint64_t hash);
+    void remove(CacheEntry *e);
+    void clear();
+    size_t size() const { return count; }
+};
+
+// One independently locked segment of the cache, holding at most
+// budgetBytes of keys, values and bookkeeping, less its part of what the
+// large-entry pool lent out, plus what its own large entries borrowed.
+// Which entry goes when the shard is over budget is up to its
+// eviction policy.
+class CacheShard {
+  private:
+    size_t budgetBytes;
+    size_t usedBytes = 0;
+    size_t borrowedBytes = 0;  // charge of large entries, owed to largePool
+    CacheLargePool &largePool;
+    CacheIndex index;
+    unique_ptr<EvictionPolicy> policy;
     mutable mutex mtx;
 
+    CacheRefresher &refresher;
+    atomic<uint64_t> &versions;
+
+    // A load in progress. invalidated is set when the key is erased or
+    // marked stale meanwhile, so a result computed from older data is not
+    // cached. version is the result's, readable once result is ready.
+    struct Flight {
+      promise<CacheValue> done;
+      shared_future<CacheValue> result{done.get_future().share()};
+      bool invalidated = false;
+      uint64_t version = 0;
+    };
+    unordered_map<string, shared_ptr<Flight>> inflight;
+    CacheLoadStats loadStats;
+
+    // Entries by each tag they carry
+    unordered_map<uint64_t, unordered_set<CacheEntry *>> tagged;
+
+    CacheEntry *findLive(const string &key, uint64_t hash);
+    void insertEntry(const string &key, uint64_t hash, CacheValue value, uint32_t cost, CacheExpiry expiry,
+                     CacheTags tags, uint64_t version);
+    uint64_t resolveVersion(uint64_t version);
+    void removeEntry(CacheEntry *e);
+    void repay(CacheEntry *e);
+    bool grow(CacheEntry *e, size_t bytes);
+    void untag(CacheEntry *e);
+    void evictOverBudget();
+    CacheValue runLoad(const string &key, uint64_t hash, const shared_ptr<Flight> &flight,
+                       const CacheLoader &loader, uint32_t cost, CacheExpiry expiry, uint64_t *version);
+    void finishLoad(const string &key, uint64_t hash, const shared_ptr<Flight> &flight,
+                    CacheValue value, bool cacheable, uint32_t cost, CacheExpiry expiry, CacheTags tags,
+                    uint64_t version);
+
+  public:
+    CacheShard(size_t budget, EvictionPolicyKind policyKind, CacheLargePool &largePool,
+               CacheRefresher &refresher, atomic<uint64_t> &versions);
+
+    bool exists(const string &key, uint64_t hash);
+    CacheValue try_get(const string &key, uint64_t hash);
+    void put(const string &key, uint64_t hash, CacheValue value, uint32_t cost, CacheExpiry expiry,
+             CacheTags tags, uint64_t version);
+    CacheValue get_or_load(const string &key, uint64_t hash, const CacheLoader &loader,
+                           uint32_t cost, CacheExpiry expiry, uint64_t *version);
+    void markStale(const string &key, uint64_t hash);
+    void erase(const string &key, uint64_t hash);
+    size_t invalidateTag(uint64_t tag, const function<bool(const string &)> &match);
+    CacheValue variant(const string &key, uint64_t hash, const CacheValue &value, size_t slot,
+                       const CacheEncoder &encode);
+    void clear();
+    size_t size() const;
+    size_t bytes() const;
+    CacheLoadStats stats() const;
+};
+
+// Cache split into shards chosen by key hash, so that threads working on
+// different keys do not serialize on a single mutex. Capacity is a byte
+// budget divided evenly between the shards. A value larger than one
+// shard's share borrows from all of them through the large-entry pool,
+// which lends up to CACHE_LARGE_ENTRY_PERCENT of the budget, and is not
+// cached only if that is used up.
+//
+// put() takes the cost of recomputing the value, in single-row lookups
+// (1 for a movie by title, the row count for a listing). Cost-aware
+// policies keep expensive entries over cheap ones of the same size.
+//
+// get_or_load() is a single-flight read-through: the first miss for a key
+// runs the loader and concurrent misses for the same key wait for its
+// result instead of repeating the work. If the loader throws, every one of
+// them gets the exception. A loader must not load its own key.
+//
+// Entries may carry a CacheExpiry, and markStale() ends an entry's
+// freshness immediately. A stale entry is still returned at once, and
+// get_or_load() then refreshes it on a background thread (one refresh per
+// key at a time). Such a loader runs after the caller has returned, so it
+// must capture by value anything that does not outlive the cache.
+//
+// Entries may also carry tags naming what they were computed from (put's
+// tags, or those a loader fills in). invalidateTag() drops exactly the
+// entries carrying a tag, optionally filtered by key, so a write only
+// costs the entries it affects. It also keeps the loads in flight whose
+// key passes the filter from caching their result, since that result's
+// tags are not known yet.
+//
+// variant() keeps up to CACHE_VARIANTS encoded forms of an entry's value
+// with the entry, charged to its budget. Each is built on first request
+// and dropped when the value is replaced, so a hit never encodes again.
+// A value the cache does not hold is encoded for the caller alone.
+//
+// Every value has a version that changes whenever the key's value does:
+// the one its put or loader supplied, or else a unique one with
+// CACHE_AUTO_VERSION set. get_or_load() reports it, e.g. for an ETag.
+class Cache {
+  private:
+    vector<unique_ptr<CacheShard>> shards;
+    hash<string> hasher;
+    size_t budgetBytes;
+    atomic<uint64_t> versions{0};
+    CacheLargePool largePool;
+    // Declared after the shards so it stops before they are destroyed
+    CacheRefresher refresher;
+
+    CacheShard &shardFor(uint64_t hash);
+
   public:
-    explicit Cache(size_t cap = 1000);
+    explicit Cache(size_t budget = DEFAULT_CACHE_BUDGET_BYTES, size_t numShards = DEFAULT_CACHE_SHARDS,
+                   EvictionPolicyKind policyKind = EvictionPolicyKind::WTinyLFU);
 
     bool exists(const string &key);
     string get(const string &key);
-    void put(const string &key, const string &value);
+    CacheValue try_get(const string &key);
+    void put(const string &key, CacheValue value, uint32_t cost = 1, CacheExpiry expiry = {},
+             CacheTags tags = {}, uint64_t version = 0);
+    void put(const string &key, string value, uint32_t cost = 1, CacheExpiry expiry = {},
+             CacheTags tags = {}, uint64_t version = 0);
+    CacheValue get_or_load(const string &key, const CacheLoader &loader, uint32_t cost = 1,
+                           CacheExpiry expiry = {}, uint64_t *version = nullptr);
+    void markStale(const string &key);
     void erase(const string &key);
+    size_t invalidateTag(uint64_t tag, const function<bool(const string &)> &match = nullptr);
+    CacheValue variant(const string &key, const CacheValue &value, size_t slot, const CacheEncoder &encode);
     void clear();
     size_t size() const;
-};
\ No newline at end of file
+    size_t bytes() const;
+    size_t budget() const;
+    size_t largeBytes() const;
+    size_t shardCount() const;
+    CacheLoadStats loadStats() const;
+};
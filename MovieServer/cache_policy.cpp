@@ -0,0 +1,271 @@
+#include "cache_policy.h"
+#include <algorithm>
+
+using namespace std;
+
+size_t cache_entry_charge(const string &key, const CacheValue &value, const CacheTags &tags) {
+  return key.size() + (value ? value->size() : 0) + tags.size() * sizeof(uint64_t) + CACHE_ENTRY_OVERHEAD;
+}
+
+void EntryList::pushFront(CacheEntry *e) {
+  e->prev = nullptr;
+  e->next = head;
+  if (head) head->prev = e;
+  head = e;
+  if (!tail) tail = e;
+  count++;
+  totalBytes += e->charge;
+}
+
+void EntryList::remove(CacheEntry *e) {
+  if (e->prev) e->prev->next = e->next; else head = e->next;
+  if (e->next) e->next->prev = e->prev; else tail = e->prev;
+  e->prev = e->next = nullptr;
+  count--;
+  totalBytes -= e->charge;
+}
+
+void EntryList::moveToFront(CacheEntry *e) {
+  if (head == e) return;
+  remove(e);
+  pushFront(e);
+}
+
+void EntryList::resize(CacheEntry *e, size_t charge) {
+  totalBytes = totalBytes - e->charge + charge;
+  e->charge = charge;
+}
+
+void EntryList::clear() {
+  head = tail = nullptr;
+  count = 0;
+  totalBytes = 0;
+}
+
+// Build the policy for one shard of the given byte budget
+unique_ptr<EvictionPolicy> make_eviction_policy(EvictionPolicyKind kind, size_t budgetBytes) {
+  switch (kind) {
+    case EvictionPolicyKind::LRU:
+      return make_unique<LruPolicy>();
+    case EvictionPolicyKind::GreedyDual:
+      return make_unique<GreedyDualPolicy>(budgetBytes);
+    case EvictionPolicyKind::WTinyLFU:
+    default:
+      return make_unique<TinyLfuPolicy>(budgetBytes);
+  }
+}
+
+// Sketch sized to the next power of two of capacity words, aged every
+// 10 x capacity increments
+FrequencySketch::FrequencySketch(size_t capacity) {
+  size_t words = 1;
+  while (words < max<size_t>(capacity, 16)) words <<= 1;
+  table.assign(words, 0);
+  mask = words - 1;
+  sampleSize = 10 * max<size_t>(capacity, 1);
+}
+
+// Spread the key hash differently for each of the 4 rows
+uint64_t FrequencySketch::rehash(uint64_t hash, int row) {
+  static const uint64_t SEEDS[] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+                                   0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+  uint64_t h = (hash + SEEDS[row]) * 0x9e3779b97f4a7c15ULL;
+  return h ^ (h >> 32);
+}
+
+void FrequencySketch::increment(uint64_t hash) {
+  bool added = false;
+  for (int row = 0; row < 4; row++) {
+    uint64_t h = rehash(hash, row);
+    uint64_t &word = table[h & mask];
+    int shift = static_cast<int>(((h >> 40) & 3) * 16 + row * 4);  // one counter per row within the word
+    if (((word >> shift) & 0xF) < 15) {
+      word += 1ULL << shift;
+      added = true;
+    }
+  }
+  if (added && ++additions >= sampleSize) reset();
+}
+
+// Estimated count: the minimum over the rows
+int FrequencySketch::frequency(uint64_t hash) const {
+  int freq = 15;
+  for (int row = 0; row < 4; row++) {
+    uint64_t h = rehash(hash, row);
+    int shift = static_cast<int>(((h >> 40) & 3) * 16 + row * 4);
+    freq = min(freq, static_cast<int>((table[h & mask] >> shift) & 0xF));
+  }
+  return freq;
+}
+
+// Halve every counter
+void FrequencySketch::reset() {
+  for (uint64_t &word : table) word = (word >> 1) & 0x7777777777777777ULL;
+  additions /= 2;
+}
+
+void FrequencySketch::clear() {
+  fill(table.begin(), table.end(), 0);
+  additions = 0;
+}
+
+// 1% of the budget is the admission window, 80% of the rest is protected.
+// The sketch is sized for the number of typical entries the budget holds.
+TinyLfuPolicy::TinyLfuPolicy(size_t budgetBytes)
+    : maxBytes(budgetBytes),
+      windowMax(max<size_t>(1, budgetBytes / 100)),
+      protectedMax((budgetBytes > windowMax ? budgetBytes - windowMax : 0) * 8 / 10),
+      sketch(budgetBytes / CACHE_AVERAGE_ENTRY_BYTES) {}
+
+void TinyLfuPolicy::onInsert(CacheEntry *e) {
+  sketch.increment(e->hash);
+  e->segment = WINDOW;
+  window.pushFront(e);
+
+  // While the shard still has room the window's overflow moves into
+  // probation unchallenged; once full, victim() makes it compete
+  while (window.bytes() > windowMax && window.size() > 1 &&
+         window.bytes() + probation.bytes() + protectedList.bytes() <= maxBytes) {
+    CacheEntry *overflow = window.back();
+    window.remove(overflow);
+    overflow->segment = PROBATION;
+    probation.pushFront(overflow);
+  }
+}
+
+void TinyLfuPolicy::onAccess(CacheEntry *e) {
+  sketch.increment(e->hash);
+  switch (e->segment) {
+    case WINDOW:
+      window.moveToFront(e);
+      break;
+    case PROBATION:
+      // A second hit promotes to protected, demoting its oldest entry if full
+      probation.remove(e);
+      e->segment = PROTECTED;
+      protectedList.pushFront(e);
+      while (protectedList.bytes() > protectedMax && protectedList.back() != e) {
+        CacheEntry *demoted = protectedList.back();
+        protectedList.remove(demoted);
+        demoted->segment = PROBATION;
+        probation.pushFront(demoted);
+      }
+      break;
+    case PROTECTED:
+      protectedList.moveToFront(e);
+      break;
+  }
+}
+
+void TinyLfuPolicy::onRemove(CacheEntry *e) {
+  switch (e->segment) {
+    case WINDOW: window.remove(e); break;
+    case PROBATION: probation.remove(e); break;
+    case PROTECTED: protectedList.remove(e); break;
+  }
+}
+
+// Stays in its segment, without touching the sketch
+void TinyLfuPolicy::onResize(CacheEntry *e, size_t charge, uint32_t cost) {
+  switch (e->segment) {
+    case WINDOW: window.resize(e, charge); break;
+    case PROBATION: probation.resize(e, charge); break;
+    case PROTECTED: protectedList.resize(e, charge); break;
+  }
+  e->cost = cost;
+}
+
+// Misses count towards popularity too, so a key that keeps being asked
+// for earns admission
+void TinyLfuPolicy::onMiss(uint64_t hash) {
+  sketch.increment(hash);
+}
+
+CacheEntry *TinyLfuPolicy::mainVictim() const {
+  if (probation.back()) return probation.back();
+  return protectedList.back();
+}
+
+// Worth of keeping an entry: how often it is used times what recomputing
+// it costs, per byte it occupies
+double TinyLfuPolicy::value(const CacheEntry *e) const {
+  return (sketch.frequency(e->hash) + 1.0) * e->cost / e->charge;
+}
+
+// While the window is within its share, evict from the main area. Once it
+// overflows, its oldest entry is the candidate: it moves into probation
+// only if it is more valuable than the main area's victim, otherwise the
+// candidate itself is evicted.
+CacheEntry *TinyLfuPolicy::victim() {
+  CacheEntry *mainCandidate = mainVictim();
+  if (window.bytes() <= windowMax && mainCandidate) return mainCandidate;
+
+  CacheEntry *candidate = window.back();
+  if (!candidate) return mainCandidate;
+  if (!mainCandidate) return candidate;
+
+  if (value(candidate) > value(mainCandidate)) {
+    window.remove(candidate);
+    candidate->segment = PROBATION;
+    probation.pushFront(candidate);
+    return mainCandidate;
+  }
+  return candidate;
+}
+
+void TinyLfuPolicy::clear() {
+  window.clear();
+  probation.clear();
+  protectedList.clear();
+  sketch.clear();
+}
+
+GreedyDualPolicy::GreedyDualPolicy(size_t budgetBytes)
+    : sketch(budgetBytes / CACHE_AVERAGE_ENTRY_BYTES) {}
+
+// (Re)compute an entry's priority from the current inflation value
+void GreedyDualPolicy::enqueue(CacheEntry *e) {
+  e->priority = inflation + (sketch.frequency(e->hash) + 1.0) * e->cost / e->charge;
+  queue.emplace(e->priority, e);
+}
+
+void GreedyDualPolicy::onInsert(CacheEntry *e) {
+  sketch.increment(e->hash);
+  enqueue(e);
+}
+
+void GreedyDualPolicy::onAccess(CacheEntry *e) {
+  queue.erase({e->priority, e});
+  sketch.increment(e->hash);
+  enqueue(e);
+}
+
+void GreedyDualPolicy::onRemove(CacheEntry *e) {
+  queue.erase({e->priority, e});
+}
+
+// Reprice for the new cost per byte, keeping the inflation value the
+// entry was last queued with
+void GreedyDualPolicy::onResize(CacheEntry *e, size_t charge, uint32_t cost) {
+  queue.erase({e->priority, e});
+  double hits = sketch.frequency(e->hash) + 1.0;
+  double base = e->priority - hits * e->cost / e->charge;
+  e->charge = charge;
+  e->cost = cost;
+  e->priority = base + hits * cost / charge;
+  queue.emplace(e->priority, e);
+}
+
+// Lowest priority goes; everything left ages relative to it
+CacheEntry *GreedyDualPolicy::victim() {
+  if (queue.empty()) return nullptr;
+  CacheEntry *e = queue.begin()->second;
+  inflation = e->priority;
+  return e;
+}
+
+void GreedyDualPolicy::clear() {
+  queue.clear();
+  sketch.clear();
+  inflation = 0;
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Cached values are immutable, reference-counted buffers: a hit hands out
+// another reference instead of copying the bytes
+using CacheValue = shared_ptr<const string>;
+
+// What a cached value depends on (e.g. the movie ids in a search result),
+// so a write can invalidate exactly the entries it affects
+using CacheTags = vector<uint64_t>;
+
+// Bookkeeping bytes charged per entry on top of key and value: the entry
+// itself, its index slot and the value's control block
+#define CACHE_ENTRY_OVERHEAD (sizeof(CacheEntry) + 64)
+
+// Encoded forms (e.g. compressed) an entry can keep of its value
+#define CACHE_VARIANTS 2
+
+// Typical entry size, used to size per-entry structures from a byte budget
+#define CACHE_AVERAGE_ENTRY_BYTES 256
+
+// One cached key/value. charge is the entry's byte footprint and cost how
+// expensive the value is to recompute (1 = a single-row lookup). The value
+// is fresh until freshUntil and served stale until expiresAt (max = never).
+// tags are the dependencies the value was recorded with, variants the
+// encoded forms built from it so far (encoding flags the ones being built).
+// version identifies the value (see Cache). large marks an entry whose
+// charge is borrowed from the cache's large-entry pool.
+// prev/next/segment/priority belong to the eviction policy, which threads
+// entries through its own intrusive lists.
+struct CacheEntry {
+  string key;
+  CacheValue value;
+  CacheTags tags;
+  CacheValue variants[CACHE_VARIANTS];
+  uint64_t hash = 0;
+  uint64_t version = 0;
+  size_t charge = 0;
+  chrono::steady_clock::time_point freshUntil = chrono::steady_clock::time_point::max();
+  chrono::steady_clock::time_point expiresAt = chrono::steady_clock::time_point::max();
+  CacheEntry *prev = nullptr;
+  CacheEntry *next = nullptr;
+  double priority = 0;
+  uint32_t cost = 1;
+  uint8_t segment = 0;
+  uint8_t encoding = 0;
+  bool large = false;
+};
+
+// Bytes an entry with this key, value and tags accounts for
+size_t cache_entry_charge(const string &key, const CacheValue &value, const CacheTags &tags);
+
+// Intrusive doubly-linked list of entries, front is most recent. Tracks
+// the total charge of its entries as well as their number.
+class EntryList {
+  private:
+    CacheEntry *head = nullptr;
+    CacheEntry *tail = nullptr;
+    size_t count = 0;
+    size_t totalBytes = 0;
+
+  public:
+    void pushFront(CacheEntry *e);
+    void remove(CacheEntry *e);
+    void moveToFront(CacheEntry *e);
+    void resize(CacheEntry *e, size_t charge);
+    CacheEntry *back() const { return tail; }
+    size_t size() const { return count; }
+    size_t bytes() const { return totalBytes; }
+    void clear();
+};
+
+enum class EvictionPolicyKind {
+  LRU,           // plain least-recently-used
+  WTinyLFU,      // windowed LRU + frequency-filtered segmented LRU (default)
+  GreedyDual     // GreedyDual-Size-Frequency: cost per byte, aged by inflation
+};
+
+// Decides which entry a shard over its byte budget evicts. Called with the
+// shard lock held. A linked entry's charge and cost only change through
+// onResize().
+class EvictionPolicy {
+  public:
+    virtual ~EvictionPolicy() = default;
+
+    virtual void onInsert(CacheEntry *e) = 0;
+    virtual void onAccess(CacheEntry *e) = 0;
+    virtual void onRemove(CacheEntry *e) = 0;
+    virtual void onMiss(uint64_t hash) { (void)hash; }
+
+    // The entry's charge and cost change in place (its value was replaced
+    // or grew a variant): it keeps its position and is not counted as a use
+    virtual void onResize(CacheEntry *e, size_t charge, uint32_t cost) = 0;
+
+    // Entry to evict from a shard that is over budget
+    virtual CacheEntry *victim() = 0;
+    virtual void clear() = 0;
+};
+
+unique_ptr<EvictionPolicy> make_eviction_policy(EvictionPolicyKind kind, size_t budgetBytes);
+
+// Least-recently-used: evict the tail of one recency list
+class LruPolicy : public EvictionPolicy {
+  private:
+    EntryList lru;
+
+  public:
+    void onInsert(CacheEntry *e) override { lru.pushFront(e); }
+    void onAccess(CacheEntry *e) override { lru.moveToFront(e); }
+    void onRemove(CacheEntry *e) override { lru.remove(e); }
+    void onResize(CacheEntry *e, size_t charge, uint32_t cost) override {
+      lru.resize(e, charge);
+      e->cost = cost;
+    }
+    CacheEntry *victim() override { return lru.back(); }
+    void clear() override { lru.clear(); }
+};
+
+// Count-min sketch of 4-bit counters estimating how often a key was seen.
+// Counters are halved periodically so old popularity fades.
+class FrequencySketch {
+  private:
+    vector<uint64_t> table; // 16 counters of 4 bits per word
+    uint64_t mask = 0;
+    size_t additions = 0;
+    size_t sampleSize = 0;
+
+    static uint64_t rehash(uint64_t hash, int row);
+    void reset();
+
+  public:
+    explicit FrequencySketch(size_t capacity);
+
+    void increment(uint64_t hash);
+    int frequency(uint64_t hash) const;
+    void clear();
+};
+
+// W-TinyLFU: new entries land in a small LRU window; when the window
+// overflows its oldest entry competes with the main cache's eviction
+// candidate and only the more valuable one stays, valued as sketch
+// frequency x recompute cost per byte. A burst of one-off keys therefore
+// churns the window instead of flushing popular or expensive entries. The
+// main area is a segmented LRU (probation/protected). Segment limits are
+// in bytes.
+class TinyLfuPolicy : public EvictionPolicy {
+  private:
+    enum Segment : uint8_t { WINDOW = 0, PROBATION = 1, PROTECTED = 2 };
+
+    EntryList window;
+    EntryList probation;
+    EntryList protectedList;
+    size_t maxBytes;
+    size_t windowMax;
+    size_t protectedMax;
+    FrequencySketch sketch;
+
+    CacheEntry *mainVictim() const;
+    double value(const CacheEntry *e) const;
+
+  public:
+    explicit TinyLfuPolicy(size_t budgetBytes);
+
+    void onInsert(CacheEntry *e) override;
+    void onAccess(CacheEntry *e) override;
+    void onRemove(CacheEntry *e) override;
+    void onResize(CacheEntry *e, size_t charge, uint32_t cost) override;
+    void onMiss(uint64_t hash) override;
+    CacheEntry *victim() override;
+    void clear() override;
+};
+
+// GreedyDual-Size-Frequency: each entry's priority is the current
+// inflation value plus hits x cost / charge, and the lowest priority goes.
+// Evicting raises the inflation value to the victim's priority, so entries
+// that stop being used age out however expensive they were.
+class GreedyDualPolicy : public EvictionPolicy {
+  private:
+    set<pair<double, CacheEntry *>> queue;
+    FrequencySketch sketch;
+    double inflation = 0;
+
+    void enqueue(CacheEntry *e);
+
+  public:
+    explicit GreedyDualPolicy(size_t budgetBytes);
+
+    void onInsert(CacheEntry *e) override;
+    void onAccess(CacheEntry *e) override;
+    void onRemove(CacheEntry *e) override;
+    void onResize(CacheEntry *e, size_t charge, uint32_t cost) override;
+    CacheEntry *victim() override;
+    void clear() override;
+};
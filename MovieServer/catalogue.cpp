@@ -0,0 +1,162 @@
+#include "catalogue.h"
+#include "logger.h"
+
+using namespace std;
+
+// Whether the catalogue holds the whole table
+bool Catalogue::isWarm() const {
+  shared_lock<shared_mutex> lock(mtx);
+  return warm;
+}
+
+// Counter bumped by every write and every load
+uint64_t Catalogue::version() const {
+  return catalogueVersion.load(memory_order_acquire);
+}
+
+// Take a ticket before reading the table from the DB
+uint64_t Catalogue::beginLoad() const {
+  shared_lock<shared_mutex> lock(mtx);
+  return catalogueVersion.load(memory_order_acquire);
+}
+
+// Install rows read from the DB. The rows are discarded if a write was
+// patched in after the ticket was taken, since they may predate it.
+bool Catalogue::load(uint64_t ticket, vector<CatalogueRow> rows) {
+  map<int, CatalogueRow> loaded;
+  TitleIndex index;
+  for (CatalogueRow &row : rows) {
+    int id = row.movie.id;
+    index.add(id, row.movie.title);
+    loaded.emplace_hint(loaded.end(), id, std::move(row));
+  }
+
+  unique_lock<shared_mutex> lock(mtx);
+  if (catalogueVersion.load(memory_order_acquire) != ticket) {
+    LOG_DEBUG("Catalogue load raced with a write, discarded");
+    return false;
+  }
+  movies = std::move(loaded);
+  titleIndex = std::move(index);
+  warm = true;
+  catalogueVersion.fetch_add(1, memory_order_release);
+  LOG_INFO("Catalogue loaded with %zu movies", movies.size());
+  return true;
+}
+
+// Insert or replace a movie after a successful DB write
+void Catalogue::upsert(const Movie &movie) {
+  string json = movie_to_json(movie);
+  unique_lock<shared_mutex> lock(mtx);
+  catalogueVersion.fetch_add(1, memory_order_release);
+  if (!warm) return;
+  store(movie, std::move(json));
+}
+
+// Insert or replace many movies under one lock, as a single write: the
+// version (and so every cached listing) moves on once for the batch
+void Catalogue::upsert(const vector<Movie> &batch) {
+  vector<string> json;
+  json.reserve(batch.size());
+  for (const Movie &movie : batch) json.push_back(movie_to_json(movie));
+
+  unique_lock<shared_mutex> lock(mtx);
+  catalogueVersion.fetch_add(1, memory_order_release);
+  if (!warm) return;
+  for (size_t i = 0; i < batch.size(); i++) store(batch[i], std::move(json[i]));
+}
+
+// Put a row in place, indexing its title only when the movie is new or
+// renamed: a rating update leaves the posting lists alone. Caller holds mtx.
+void Catalogue::store(const Movie &movie, string json) {
+  CatalogueRow &row = movies[movie.id];
+  bool indexed = !row.json.empty() && row.movie.title == movie.title;
+  row = CatalogueRow{movie, std::move(json)};
+  if (!indexed) titleIndex.add(movie.id, movie.title);
+}
+
+// Remove a movie after a successful DB delete
+void Catalogue::erase(int id) {
+  unique_lock<shared_mutex> lock(mtx);
+  catalogueVersion.fetch_add(1, memory_order_release);
+  if (!warm) return;
+  movies.erase(id);
+  titleIndex.remove(id);
+}
+
+// Whole catalogue as a JSON array. Built by concatenating the per-movie
+// JSON kept in each entry, and only when the catalogue changed since the
+// last call. Returns nullptr while the catalogue is cold. version, if
+// given, receives the catalogue version the listing reflects.
+CacheValue Catalogue::list(uint64_t *version) const {
+  lock_guard<mutex> build(listMtx);
+  shared_lock<shared_mutex> lock(mtx);
+  if (!warm) return nullptr;
+
+  uint64_t current = catalogueVersion.load(memory_order_acquire);
+  if (version) *version = current;
+  if (listJson && listVersion == current) return listJson;
+
+  size_t bytes = 2;
+  for (const auto &kv : movies) bytes += kv.second.json.size() + 1;
+
+  string out;
+  out.reserve(bytes);
+  out += '[';
+  for (const auto &kv : movies) {
+    if (out.size() > 1) out += ',';
+    out += kv.second.json;
+  }
+  out += ']';
+
+  listJson = make_shared<const string>(std::move(out));
+  listVersion = current;
+  return listJson;
+}
+
+// One keyset page: the JSON of up to limit movies with id > afterId, in id
+// order (limit must be at least 1). nextId is the cursor for the following
+// page, or 0 on the last one. Returns false while the catalogue is cold.
+bool Catalogue::page(int afterId, size_t limit, string &rowsJson, int &nextId) const {
+  shared_lock<shared_mutex> lock(mtx);
+  if (!warm) return false;
+
+  rowsJson = "[";
+  nextId = 0;
+  size_t count = 0;
+  for (auto it = movies.upper_bound(afterId); it != movies.end(); ++it) {
+    if (count == limit) {
+      nextId = prev(it)->first;
+      break;
+    }
+    if (count > 0) rowsJson += ',';
+    rowsJson += it->second.json;
+    count++;
+  }
+  rowsJson += ']';
+  return true;
+}
+
+// Movies whose title contains query (ignoring case) as a JSON array in id
+// order, and their ids, answered from the trigram index. Returns false
+// while cold.
+bool Catalogue::search(const string &query, string &rowsJson, vector<int> &ids) const {
+  shared_lock<shared_mutex> lock(mtx);
+  if (!warm) return false;
+
+  ids = titleIndex.search(query);
+
+  rowsJson = "[";
+  for (int id : ids) {
+    if (rowsJson.size() > 1) rowsJson += ',';
+    rowsJson += movies.at(id).json;
+  }
+  rowsJson += ']';
+  return true;
+}
+
+// Number of movies held
+size_t Catalogue::size() const {
+  shared_lock<shared_mutex> lock(mtx);
+  return movies.size();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "movie.h"
+#include "title_index.h"
+
+using namespace std;
+
+// A movie together with its serialized JSON object
+struct CatalogueRow {
+  Movie movie;
+  string json;  // movie serialized once, reused by every listing
+};
+
+// In-memory, id-ordered copy of the movies table. Once loaded it is patched
+// by every write, so listing never has to scan the table again.
+class Catalogue {
+  private:
+    mutable shared_mutex mtx;
+    map<int, CatalogueRow> movies;
+    TitleIndex titleIndex;
+    bool warm = false;
+
+    // Bumped by every write (even while cold) and every load: detects loads
+    // racing with writes and versions the cached listing pages
+    atomic<uint64_t> catalogueVersion{0};
+    mutable mutex listMtx;
+    mutable CacheValue listJson;    // last serialized listing
+    mutable uint64_t listVersion = 0;
+
+    void store(const Movie &movie, string json);
+
+  public:
+    bool isWarm() const;
+    uint64_t version() const;
+
+    uint64_t beginLoad() const;
+    bool load(uint64_t ticket, vector<CatalogueRow> rows);
+
+    void upsert(const Movie &movie);
+    void upsert(const vector<Movie> &batch);
+    void erase(int id);
+
+    CacheValue list(uint64_t *version = nullptr) const;
+    bool page(int afterId, size_t limit, string &rowsJson, int &nextId) const;
+    bool search(const string &query, string &rowsJson, vector<int> &ids) const;
+    size_t size() const;
+};
@@ -0,0 +1,222 @@
+#include "connection_pool.h"
+#include "logger.h"
+
+using namespace std;
+
+// SQL text of every prepared statement, indexed by Stmt
+static const char *STATEMENT_SQL[] = {
+  "INSERT INTO movies (title, genre, release_year, rating) VALUES (?, ?, ?, ?)",
+  "SELECT * FROM movies WHERE id = LAST_INSERT_ID()",
+  "SELECT * FROM movies WHERE id > ? ORDER BY id LIMIT ?",
+  "SELECT * FROM movies WHERE LOWER(title) LIKE LOWER(?)",
+  "UPDATE movies SET rating = ? WHERE id = ?",
+  "SELECT * FROM movies WHERE id = ?",
+  "DELETE FROM movies WHERE id = ?"
+};
+
+static_assert(sizeof(STATEMENT_SQL) / sizeof(STATEMENT_SQL[0]) == static_cast<size_t>(Stmt::Count),
+              "every Stmt needs its SQL text");
+
+// Wrap a fresh connection and prepare all statements on it up front
+DBConnection::DBConnection(sql::Connection *raw) : con(raw) {
+  for (int i = 0; i < static_cast<int>(Stmt::Count); i++) {
+    statements[i].reset(con->prepareStatement(STATEMENT_SQL[i]));
+  }
+}
+
+// Get a prepared statement, ready for its parameters to be bound
+sql::PreparedStatement *DBConnection::statement(Stmt id) {
+  sql::PreparedStatement *pstmt = statements[static_cast<int>(id)].get();
+  pstmt->clearParameters();
+  return pstmt;
+}
+
+// Get the multi-row INSERT for rows movies (at most INSERT_BATCH_ROWS),
+// parameters bound as title, genre, release_year, rating per row. Both
+// sizes a bulk add uses are prepared on first use and kept.
+sql::PreparedStatement *DBConnection::insertBatch(size_t rows) {
+  unique_ptr<sql::PreparedStatement> &pstmt = insertBatches[rows == INSERT_BATCH_ROWS ? 0 : 1];
+  if (!pstmt || (rows != INSERT_BATCH_ROWS && rows != shortBatchRows)) {
+    string sql = "INSERT INTO movies (title, genre, release_year, rating) VALUES ";
+    sql.reserve(sql.size() + rows * 15);
+    for (size_t i = 0; i < rows; i++) sql += i ? ",(?,?,?,?)" : "(?,?,?,?)";
+    pstmt.reset(con->prepareStatement(sql));
+    if (rows != INSERT_BATCH_ROWS) shortBatchRows = rows;
+  }
+  pstmt->clearParameters();
+  return pstmt.get();
+}
+
+// Check whether the server side of the connection is still usable
+bool DBConnection::isAlive() {
+  try {
+    return !con->isClosed() && con->isValid();
+  } catch (sql::SQLException &) {
+    return false;
+  }
+}
+
+ConnectionPool::Lease::Lease(Lease &&other) noexcept
+    : pool(other.pool), conn(std::move(other.conn)), broken(other.broken) {
+  other.pool = nullptr;
+}
+
+ConnectionPool::Lease &ConnectionPool::Lease::operator=(Lease &&other) noexcept {
+  if (this != &other) {
+    release();
+    pool = other.pool;
+    conn = std::move(other.conn);
+    broken = other.broken;
+    other.pool = nullptr;
+  }
+  return *this;
+}
+
+ConnectionPool::Lease::~Lease() {
+  release();
+}
+
+// Return the connection to its pool early
+void ConnectionPool::Lease::release() {
+  if (pool && conn) pool->giveBack(std::move(conn), broken);
+  pool = nullptr;
+}
+
+// Constructor: open the minimum number of connections up front
+ConnectionPool::ConnectionPool(Factory f, const PoolConfig &cfg) : factory(std::move(f)), config(cfg) {
+  if (config.maxSize == 0) config.maxSize = 1;
+  if (config.minSize > config.maxSize) config.minSize = config.maxSize;
+  counters.maxSize = config.maxSize;
+
+  for (size_t i = 0; i < config.minSize; i++) {
+    {
+      lock_guard<mutex> lock(mtx);
+      openCount++;
+    }
+    unique_ptr<DBConnection> conn = create();
+    if (!conn) {
+      lock_guard<mutex> lock(mtx);
+      openCount--;
+      break;
+    }
+    giveBack(std::move(conn), false);
+  }
+  LOG_INFO("Connection pool ready (%zu open, min %zu, max %zu)",
+           stats().size, config.minSize, config.maxSize);
+}
+
+// Destructor
+ConnectionPool::~ConnectionPool() {
+  lock_guard<mutex> lock(mtx);
+  if (openCount != idle.size()) {
+    LOG_WARN("Connection pool destroyed with %zu connections still checked out", openCount - idle.size());
+  }
+  idle.clear();
+}
+
+// Open a new connection, nullptr on failure
+unique_ptr<DBConnection> ConnectionPool::create() {
+  try {
+    unique_ptr<DBConnection> conn = factory();
+    lock_guard<mutex> lock(mtx);
+    counters.created++;
+    return conn;
+  } catch (sql::SQLException &e) {
+    LOG_ERROR("Failed to open DB connection: %s", e.what());
+    return nullptr;
+  }
+}
+
+// Take a connection back (or close it if it is broken) and wake a waiter
+void ConnectionPool::giveBack(unique_ptr<DBConnection> conn, bool broken) {
+  {
+    lock_guard<mutex> lock(mtx);
+    if (broken) {
+      openCount--;
+      counters.discarded++;
+    } else {
+      idle.push_back({std::move(conn), chrono::steady_clock::now()});
+    }
+  }
+  // A broken connection is closed outside the lock
+  conn.reset();
+  available.notify_one();
+}
+
+// Check out a connection. Reuses an idle one (validating it if it sat idle
+// for a while), opens a new one while below maxSize, otherwise waits up to
+// acquireTimeout. Returns an empty lease if none could be obtained.
+ConnectionPool::Lease ConnectionPool::acquire() {
+  auto start = chrono::steady_clock::now();
+  auto deadline = start + config.acquireTimeout;
+  bool hadToWait = false;
+
+  unique_lock<mutex> lock(mtx);
+  while (true) {
+    if (!idle.empty()) {
+      IdleConnection entry = std::move(idle.back());
+      idle.pop_back();
+      bool stale = entry.since + config.validateAfterIdle < chrono::steady_clock::now();
+      lock.unlock();
+
+      if (stale && !entry.conn->isAlive()) {
+        LOG_WARN("Discarding dead idle DB connection, reconnecting");
+        entry.conn.reset();
+        entry.conn = create();
+        lock.lock();
+        counters.discarded++;
+        if (!entry.conn) {
+          openCount--;
+          available.notify_one();
+          return Lease();
+        }
+      } else {
+        lock.lock();
+      }
+      return recordCheckout(lock, std::move(entry.conn), start, hadToWait);
+    }
+
+    if (openCount < config.maxSize) {
+      openCount++;
+      lock.unlock();
+      unique_ptr<DBConnection> conn = create();
+      lock.lock();
+      if (!conn) {
+        openCount--;
+        available.notify_one();
+        return Lease();
+      }
+      return recordCheckout(lock, std::move(conn), start, hadToWait);
+    }
+
+    hadToWait = true;
+    if (available.wait_until(lock, deadline) == cv_status::timeout && idle.empty() &&
+        openCount >= config.maxSize) {
+      counters.timeouts++;
+      LOG_WARN("Timed out waiting for a DB connection (%zu in use)", openCount);
+      return Lease();
+    }
+  }
+}
+
+// Update counters for a successful checkout (lock held)
+ConnectionPool::Lease ConnectionPool::recordCheckout(unique_lock<mutex> &lock, unique_ptr<DBConnection> conn,
+                                                     chrono::steady_clock::time_point start, bool hadToWait) {
+  uint64_t waitUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+  counters.acquired++;
+  if (hadToWait) counters.waited++;
+  counters.totalWaitUs += waitUs;
+  if (waitUs > counters.maxWaitUs) counters.maxWaitUs = waitUs;
+  lock.unlock();
+  return Lease(this, std::move(conn));
+}
+
+// Snapshot of pool counters and current utilisation
+PoolStats ConnectionPool::stats() const {
+  lock_guard<mutex> lock(mtx);
+  PoolStats snapshot = counters;
+  snapshot.size = openCount;
+  snapshot.idle = idle.size();
+  snapshot.inUse = openCount - idle.size();
+  return snapshot;
+}
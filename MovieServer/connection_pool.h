@@ -0,0 +1,125 @@
+#pragma once
+#include <mysql/jdbc.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define INSERT_BATCH_ROWS 1000  // rows per multi-row INSERT of a bulk add
+
+// Statements prepared once per connection and reused for its lifetime
+enum class Stmt {
+  InsertMovie,
+  SelectLastInsert,
+  ListPage,
+  SearchTitle,
+  UpdateRating,
+  SelectById,
+  DeleteById,
+  Count
+};
+
+// A MySQL connection together with its prepared statements
+class DBConnection {
+  private:
+    unique_ptr<sql::Connection> con;
+    unique_ptr<sql::PreparedStatement> statements[static_cast<int>(Stmt::Count)];
+    unique_ptr<sql::PreparedStatement> insertBatches[2];  // INSERT_BATCH_ROWS rows, and the last shorter size used
+    size_t shortBatchRows = 0;
+
+  public:
+    explicit DBConnection(sql::Connection *raw);
+
+    sql::PreparedStatement *statement(Stmt id);
+    sql::PreparedStatement *insertBatch(size_t rows);
+    sql::Connection *connection() { return con.get(); }
+    bool isAlive();
+};
+
+// Pool sizing and timeouts
+struct PoolConfig {
+  size_t minSize = 4;                           // connections opened up front
+  size_t maxSize = 16;                          // hard cap on open connections
+  chrono::milliseconds acquireTimeout{2000};    // max wait when the pool is exhausted
+  chrono::milliseconds validateAfterIdle{5000}; // re-check connections idle longer than this
+};
+
+// Snapshot of pool counters
+struct PoolStats {
+  size_t size = 0;          // open connections
+  size_t inUse = 0;         // connections checked out right now
+  size_t idle = 0;          // connections waiting in the pool
+  size_t maxSize = 0;
+  uint64_t acquired = 0;    // successful checkouts
+  uint64_t waited = 0;      // checkouts that had to wait for a connection
+  uint64_t timeouts = 0;    // checkouts that gave up
+  uint64_t created = 0;     // connections opened
+  uint64_t discarded = 0;   // connections closed after failing validation or an error
+  uint64_t totalWaitUs = 0; // time spent waiting for a connection
+  uint64_t maxWaitUs = 0;
+};
+
+// Bounded pool of DB connections shared by all request threads
+class ConnectionPool {
+  public:
+    using Factory = function<unique_ptr<DBConnection>()>;
+
+    // RAII checkout: the connection goes back to the pool when the lease dies
+    class Lease {
+      private:
+        ConnectionPool *pool = nullptr;
+        unique_ptr<DBConnection> conn;
+        bool broken = false;
+
+      public:
+        Lease() = default;
+        Lease(ConnectionPool *p, unique_ptr<DBConnection> c) : pool(p), conn(std::move(c)) {}
+        Lease(Lease &&other) noexcept;
+        Lease &operator=(Lease &&other) noexcept;
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        ~Lease();
+
+        explicit operator bool() const { return conn != nullptr; }
+        DBConnection *operator->() const { return conn.get(); }
+        DBConnection &operator*() const { return *conn; }
+
+        // Close the connection on return instead of reusing it
+        void invalidate() { broken = true; }
+        void release();
+    };
+
+  private:
+    struct IdleConnection {
+      unique_ptr<DBConnection> conn;
+      chrono::steady_clock::time_point since;
+    };
+
+    Factory factory;
+    PoolConfig config;
+
+    mutable mutex mtx;
+    condition_variable available;
+    vector<IdleConnection> idle; // used as a stack so the warmest connection is reused first
+    size_t openCount = 0;        // idle + checked out + being created
+
+    PoolStats counters;
+
+    unique_ptr<DBConnection> create();
+    void giveBack(unique_ptr<DBConnection> conn, bool broken);
+    Lease recordCheckout(unique_lock<mutex> &lock, unique_ptr<DBConnection> conn,
+                         chrono::steady_clock::time_point start, bool hadToWait);
+
+  public:
+    ConnectionPool(Factory f, const PoolConfig &cfg);
+    ~ConnectionPool();
+
+    Lease acquire();
+    PoolStats stats() const;
+};
@@ -0,0 +1,96 @@
+#include "content_encoding.h"
+#include <brotli/encode.h>
+#include <zlib.h>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+// Trim spaces and tabs from both ends of [begin, end)
+static string trimmed(const string &s, size_t begin, size_t end) {
+  while (begin < end && (s[begin] == ' ' || s[begin] == '\t')) begin++;
+  while (end > begin && (s[end - 1] == ' ' || s[end - 1] == '\t')) end--;
+  return s.substr(begin, end - begin);
+}
+
+// Walk the comma-separated codings, keeping the q-value of each one we can
+// send ("*" stands for any coding not listed)
+ContentEncoding preferred_encoding(const string &acceptEncoding) {
+  double gzipQ = -1, brotliQ = -1, anyQ = -1;
+  size_t begin = 0;
+  while (begin < acceptEncoding.size()) {
+    size_t end = acceptEncoding.find(',', begin);
+    if (end == string::npos) end = acceptEncoding.size();
+
+    string item = trimmed(acceptEncoding, begin, end);
+    double q = 1;
+    size_t semicolon = item.find(';');
+    if (semicolon != string::npos) {
+      string param = trimmed(item, semicolon + 1, item.size());
+      if (param.size() > 2 && tolower(param[0]) == 'q' && param[1] == '=') q = atof(param.c_str() + 2);
+      item = trimmed(item, 0, semicolon);
+    }
+    for (char &c : item) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+
+    if (item == "gzip" || item == "x-gzip") gzipQ = q;
+    else if (item == "br") brotliQ = q;
+    else if (item == "*") anyQ = q;
+    begin = end + 1;
+  }
+  if (gzipQ < 0) gzipQ = anyQ;
+  if (brotliQ < 0) brotliQ = anyQ;
+
+  if (brotliQ > 0 && brotliQ >= gzipQ) return ContentEncoding::Brotli;
+  if (gzipQ > 0) return ContentEncoding::Gzip;
+  return ContentEncoding::Identity;
+}
+
+// Header value of a coding
+const char *content_encoding_name(ContentEncoding encoding) {
+  switch (encoding) {
+    case ContentEncoding::Gzip: return "gzip";
+    case ContentEncoding::Brotli: return "br";
+    default: return "identity";
+  }
+}
+
+// One-shot gzip (deflate with a gzip header and trailer)
+static bool gzip_body(const string &body, string &encoded) {
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  if (deflateInit2(&strm, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+
+  encoded.resize(deflateBound(&strm, body.size()));
+  strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(body.data()));
+  strm.avail_in = static_cast<uInt>(body.size());
+  strm.next_out = reinterpret_cast<Bytef *>(&encoded[0]);
+  strm.avail_out = static_cast<uInt>(encoded.size());
+  int ret = deflate(&strm, Z_FINISH);
+  encoded.resize(strm.total_out);
+  deflateEnd(&strm);
+  return ret == Z_STREAM_END;
+}
+
+// One-shot brotli
+static bool brotli_body(const string &body, string &encoded) {
+  size_t size = BrotliEncoderMaxCompressedSize(body.size());
+  if (size == 0) return false;
+  encoded.resize(size);
+  if (!BrotliEncoderCompress(BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, body.size(),
+                             reinterpret_cast<const uint8_t *>(body.data()), &size,
+                             reinterpret_cast<uint8_t *>(&encoded[0]))) {
+    return false;
+  }
+  encoded.resize(size);
+  return true;
+}
+
+// Compress body with a coding (identity copies it)
+bool encode_body(const string &body, ContentEncoding encoding, string &encoded) {
+  switch (encoding) {
+    case ContentEncoding::Gzip: return body.size() <= UINT32_MAX && gzip_body(body, encoded);
+    case ContentEncoding::Brotli: return brotli_body(body, encoded);
+    default:
+      encoded = body;
+      return true;
+  }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Bodies smaller than this are always sent as is: compressing them saves
+// less than the Content-Encoding header costs
+#define MIN_ENCODED_BODY_BYTES 1024
+#define GZIP_LEVEL 6      // zlib level, 1 (fastest) to 9 (smallest)
+#define BROTLI_QUALITY 5  // brotli quality, 0 (fastest) to 11 (smallest)
+
+// Content codings the server can send. Each non-identity coding is also a
+// cache variant slot (its value - 1).
+enum class ContentEncoding : uint8_t {
+  Identity,
+  Gzip,
+  Brotli
+};
+
+// Coding to answer with given a request's Accept-Encoding: the one with the
+// highest q-value, brotli over gzip on a tie, identity if neither is
+// acceptable
+ContentEncoding preferred_encoding(const string &acceptEncoding);
+
+// Content-Encoding header value of a coding
+const char *content_encoding_name(ContentEncoding encoding);
+
+// Compress body with a coding, false on failure
+bool encode_body(const string &body, ContentEncoding encoding, string &encoded);
@@ -1,241 +1,386 @@
+#include <cmath>
 #include <iostream>
 #include "db.h"
+#include "logger.h"
 
 using namespace std;
 
 // Constructor
 DBHandler::DBHandler(const string& host, const string& user, 
-                     const string& pass, const string& db) 
-    : db_host(host), db_user(user), db_pass(pass), db_name(db) {
-  driver = get_driver_instance();
-  cout << "DBHandler initialized" << endl;
+                     const string& pass, const string& db,
+                     const PoolConfig& poolConfig,
+                     const GroupCommitConfig& groupCommitConfig) 
+    : db_host(host), db_user(user), db_pass(pass), db_name(db),
+      driver(get_driver_instance()),
+      pool([this]() { return connect(); }, poolConfig),
+      groupCommit(groupCommitConfig) {
+  LOG_INFO("DBHandler initialized");
 }
 
 // Destructor
 DBHandler::~DBHandler() {
-  lock_guard<mutex> lock(connections_mutex);
-  connections.clear();
-  cout << "All database connections closed (auto-cleaned by unique_ptr)" << endl;
-  std::cout.flush();
-}
-
-// Get or create connection for current thread
-sql::Connection* DBHandler::getThreadConnection() {
-  thread::id tid = this_thread::get_id();
-  
-  {
-    lock_guard<mutex> lock(connections_mutex);
-
-    if (connections.size() >= MAX_CONNECTIONS) {
-      cout << "Connection limit reached (" << MAX_CONNECTIONS 
-           << "). Cleaning up all connections..." << endl;
-      connections.clear();  // Clear all connections
-      cout << "Connections cleaned up. New connections will be created." << endl;
+  LOG_INFO("All database connections closed (pool shut down)");
+  Logger::flush();
+}
+
+// Open a new connection for the pool (statements are prepared by DBConnection)
+unique_ptr<DBConnection> DBHandler::connect() {
+  unique_ptr<sql::Connection> con(driver->connect(db_host, db_user, db_pass));
+  con->setSchema(db_name);
+  auto conn = make_unique<DBConnection>(con.release());
+  LOG_INFO("Created new DB connection");
+  return conn;
+}
+
+// Pool counters for the metrics endpoint
+PoolStats DBHandler::poolStats() const {
+  return pool.stats();
+}
+
+// Write combiner counters for the metrics endpoint
+GroupCommitStats DBHandler::groupCommitStats() const {
+  GroupCommitStats s;
+  s.batches = groupBatches.load(memory_order_relaxed);
+  s.writes = groupWrites.load(memory_order_relaxed);
+  s.fallbacks = groupFallbacks.load(memory_order_relaxed);
+  s.maxBatch = groupMaxBatch.load(memory_order_relaxed);
+  return s;
+}
+
+// Run an operation on a pooled connection. If the connection turns out to
+// be dead it is discarded. An idempotent operation (a read) is then retried
+// once on a fresh connection, which re-prepares every statement. A write
+// is not: the server may have applied it before the reply was lost, so
+// running it again could insert or update twice, and it fails instead.
+template <typename Fn>
+bool DBHandler::execute(const char *opName, bool idempotent, Fn &&fn) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    ConnectionPool::Lease conn = pool.acquire();
+    if (!conn) {
+      LOG_ERROR("%s failed: no database connection available", opName);
+      return false;
     }
 
-    auto it = connections.find(tid);
-    if (it != connections.end() && it->second) {
-      return it->second.get();
+    try {
+      bool ok = fn(*conn);
+      // A transaction closes a connection it could not put back in autocommit
+      if (conn->connection()->isClosed()) conn.invalidate();
+      return ok;
+    } catch (sql::SQLException &e) {
+      if (!conn->isAlive()) {
+        conn.invalidate();
+        if (idempotent && attempt == 0) {
+          LOG_WARN("%s: connection lost (%s), reconnecting", opName, e.what());
+          continue;
+        }
+      }
+      LOG_ERROR("%s failed: %s", opName, e.what());
+      return false;
     }
   }
-  
-  try {
-    sql::Connection* raw_con = driver->connect(db_host, db_user, db_pass);
-    raw_con->setSchema(db_name);
-    
-    unique_ptr<sql::Connection> con(raw_con);
-    
-    {
-      lock_guard<mutex> lock(connections_mutex);
-      connections[tid] = std::move(con);  // Transfer ownership
+  return false;
+}
+
+// Transaction on a pooled connection. Rolled back unless committed, and
+// autocommit is restored either way, so the connection goes back to the
+// pool the way it came out.
+class Transaction {
+  private:
+    sql::Connection *con;
+    bool committed = false;
+
+  public:
+    explicit Transaction(sql::Connection *con) : con(con) { con->setAutoCommit(false); }
+
+    // Once COMMIT succeeded the transaction is durable, so failing to
+    // restore autocommit must not report it as failed (its writes would be
+    // run again). The connection is closed instead and never reused.
+    void commit() {
+      con->commit();
+      committed = true;
+      try {
+        con->setAutoCommit(true);
+      } catch (sql::SQLException &e) {
+        LOG_WARN("Restoring autocommit failed, closing the connection: %s", e.what());
+        try {
+          con->close();
+        } catch (sql::SQLException &) {}
+      }
     }
-    
-    cout << "Created new DB connection for thread " << tid << endl;
-    return raw_con;
-    
-  } catch (sql::SQLException& e) {
-    cerr << "Failed to create connection for thread " << tid 
-         << ": " << e.what() << endl;
-    return nullptr;
+
+    ~Transaction() {
+      if (committed) return;
+      try {
+        con->rollback();
+        con->setAutoCommit(true);
+      } catch (sql::SQLException &e) {
+        LOG_WARN("Rollback failed: %s", e.what());
+      }
+    }
+};
+
+// A write waiting in the combiner, owned by the caller's stack frame
+struct DBHandler::PendingWrite {
+  const char *opName;
+  function<bool(DBConnection &)> run;
+  bool ok = false;
+  bool done = false;
+};
+
+// Run a single-movie write through the write combiner. Writes that arrive
+// while a batch is running queue up, and the next caller to find no batch
+// running takes up to maxWrites of them and runs them as one transaction
+// on one connection: one commit, and one log flush, for all of them. So
+// batches grow with the commit latency and a lone writer never waits.
+// With a window the batch also waits that long for more writes, unless
+// it is full. Each caller gets back its own write's result.
+bool DBHandler::combineWrite(const char *opName, function<bool(DBConnection &)> fn) {
+  if (groupCommit.maxWrites <= 1) return execute(opName, false, fn);
+
+  PendingWrite write{opName, std::move(fn)};
+  unique_lock<mutex> lock(writeMutex);
+  pendingWrites.push_back(&write);
+  writeCv.notify_all();
+  while (!write.done) {
+    if (writeLeader) {
+      writeCv.wait(lock);
+      continue;
+    }
+
+    writeLeader = true;
+    if (groupCommit.window.count() > 0) {
+      writeCv.wait_for(lock, groupCommit.window, [this]() { return pendingWrites.size() >= groupCommit.maxWrites; });
+    }
+    vector<PendingWrite *> batch;
+    while (!pendingWrites.empty() && batch.size() < groupCommit.maxWrites) {
+      batch.push_back(pendingWrites.front());
+      pendingWrites.pop_front();
+    }
+    lock.unlock();
+    runWriteBatch(batch);
+    lock.lock();
+
+    for (PendingWrite *done : batch) done->done = true;
+    writeLeader = false;
+    writeCv.notify_all();
   }
+  return write.ok;
 }
 
-// Cleanup connection for current thread (after server shutdown)
-void DBHandler::cleanupThreadConnection() {
-  thread::id tid = this_thread::get_id();
-  lock_guard<mutex> lock(connections_mutex);
-  
-  auto it = connections.find(tid);
-  if (it != connections.end()) {
-    connections.erase(it);  // unique_ptr automatically deletes connection
-    cout << "Cleaned up connection for thread " << tid << endl;
+// Run a batch of writes in one transaction. If a write throws, nothing of
+// the batch is kept and each write is run again on its own, so one bad
+// write cannot fail the others. If COMMIT itself fails, the server may have
+// committed before the reply was lost: the outcome is unknown, and running
+// the writes again could apply them twice, so they all fail instead.
+void DBHandler::runWriteBatch(vector<PendingWrite *> &batch) {
+  groupBatches.fetch_add(1, memory_order_relaxed);
+  groupWrites.fetch_add(batch.size(), memory_order_relaxed);
+  uint64_t seen = groupMaxBatch.load(memory_order_relaxed);
+  while (batch.size() > seen && !groupMaxBatch.compare_exchange_weak(seen, batch.size(), memory_order_relaxed)) {}
+
+  if (batch.size() == 1) {
+    batch[0]->ok = execute(batch[0]->opName, false, batch[0]->run);
+    return;
   }
+
+  bool written = false;
+  bool committed = execute("GroupCommit", false, [&](DBConnection &conn) {
+    Transaction tx(conn.connection());
+    for (PendingWrite *write : batch) write->ok = write->run(conn);
+    written = true;
+    tx.commit();
+    return true;
+  });
+  if (committed) return;
+  if (written) {
+    LOG_ERROR("Commit of %zu grouped writes failed with unknown outcome, failing them", batch.size());
+    for (PendingWrite *write : batch) write->ok = false;
+    return;
+  }
+
+  groupFallbacks.fetch_add(1, memory_order_relaxed);
+  LOG_WARN("Group commit of %zu writes failed, running them one at a time", batch.size());
+  for (PendingWrite *write : batch) write->ok = execute(write->opName, false, write->run);
 }
 
-// Add a movie in the database
-bool DBHandler::addMovie(const string &title, const string &genre, int year, double rating) {
-  sql::Connection* con = getThreadConnection();
-  if (!con) return false;
+// Read the current movie row
+static Movie movie_from_row(sql::ResultSet &res) {
+  Movie movie;
+  movie.id = res.getInt("id");
+  movie.title = res.getString("title");
+  movie.genre = res.getString("genre");
+  movie.release_year = res.getInt("release_year");
+  movie.rating = static_cast<double>(res.getDouble("rating"));
+  return movie;
+}
 
-  try {
-    unique_ptr<sql::PreparedStatement> pstmt
-    {con->prepareStatement(
-      "INSERT INTO movies (title, genre, release_year, rating) VALUES (?, ?, ?, ?)"
-    )};
+// Add a movie in the database, the stored row (with its new id) is returned
+// in added. Group committed with concurrent writes.
+bool DBHandler::addMovie(const string &title, const string &genre, int year, double rating, Movie &added) {
+  return combineWrite("AddMovie", [&](DBConnection &conn) {
+    sql::PreparedStatement* pstmt = conn.statement(Stmt::InsertMovie);
     pstmt->setString(1, title);
     pstmt->setString(2, genre);
     pstmt->setInt(3, year);
     pstmt->setDouble(4, rating);
     pstmt->executeUpdate();
+
+    // Read back on the same connection so LAST_INSERT_ID() is ours
+    unique_ptr<sql::ResultSet> res(conn.statement(Stmt::SelectLastInsert)->executeQuery());
+    if (!res->next()) return false;
+    added = movie_from_row(*res);
     return true;
-  } catch (sql::SQLException &e) {
-    cerr << "AddMovie failed: " << e.what() << endl;
-    return false;
-  }
+  });
 }
 
-// List all movies from database
-bool DBHandler::listMovies(string &movieListJson) {
-  sql::Connection* con = getThreadConnection();
-  if (!con) return false;
+// Whether a row read back is the movie that was sent. Ratings are stored
+// as DECIMAL(2,1), so they only match to the nearest tenth.
+static bool same_movie(const Movie &stored, const Movie &sent) {
+  return stored.title == sent.title && stored.genre == sent.genre && stored.release_year == sent.release_year &&
+         fabs(stored.rating - sent.rating) <= 0.05 + 1e-9;
+}
 
-  try {
-    unique_ptr<sql::PreparedStatement> pstmt {
-      con->prepareStatement(
-        "SELECT * FROM movies ORDER BY id"
-      )
-    };
-    
+// Add movies with multi-row INSERTs of up to INSERT_BATCH_ROWS rows, all
+// in one transaction: either every movie is stored or none is. After each
+// statement its rows are read back into added, from LAST_INSERT_ID() on.
+// Those are ours when the statement got consecutive ids, but not with an
+// auto_increment_increment above 1 or every innodb_autoinc_lock_mode, so
+// each row is checked against the movie sent. On any mismatch the
+// transaction is rolled back rather than hand another writer's rows to
+// the catalogue as ours.
+bool DBHandler::addMovies(const vector<Movie> &movies, vector<Movie> &added) {
+  return execute("AddMovies", false, [&](DBConnection &conn) {
+    Transaction tx(conn.connection());
+    added.clear();
+    added.reserve(movies.size());
+    for (size_t begin = 0; begin < movies.size(); begin += INSERT_BATCH_ROWS) {
+      size_t rows = min<size_t>(INSERT_BATCH_ROWS, movies.size() - begin);
+      sql::PreparedStatement* pstmt = conn.insertBatch(rows);
+      for (size_t i = 0; i < rows; i++) {
+        const Movie &movie = movies[begin + i];
+        int column = static_cast<int>(i) * 4;
+        pstmt->setString(column + 1, movie.title);
+        pstmt->setString(column + 2, movie.genre);
+        pstmt->setInt(column + 3, movie.release_year);
+        pstmt->setDouble(column + 4, movie.rating);
+      }
+      pstmt->executeUpdate();
+
+      // LAST_INSERT_ID() is the id of the first row of the statement
+      unique_ptr<sql::ResultSet> last(conn.statement(Stmt::SelectLastInsert)->executeQuery());
+      if (!last->next()) return false;
+      sql::PreparedStatement* readBack = conn.statement(Stmt::ListPage);
+      readBack->setInt(1, last->getInt("id") - 1);
+      readBack->setInt(2, static_cast<int>(rows));
+      unique_ptr<sql::ResultSet> res(readBack->executeQuery());
+      for (size_t i = 0; i < rows; i++) {
+        if (!res->next()) return false;
+        added.push_back(movie_from_row(*res));
+        if (!same_movie(added.back(), movies[begin + i])) {
+          LOG_ERROR("AddMovies: row %d read back is not the movie sent, rolling back", added.back().id);
+          return false;
+        }
+      }
+    }
+    tx.commit();
+    return true;
+  });
+}
+
+// Stream all movies from database in id order, one callback per row. The
+// callback returns false to stop early (listing then fails). Rows are read
+// in keyset pages of LIST_PAGE_ROWS, each on a connection held only while
+// the page is fetched, so a slow reader downstream does not pin a pooled
+// connection. A page is handed out only once it has been read in full, so
+// the retry of a lost connection never repeats rows already passed on.
+bool DBHandler::listMovies(const function<bool(const Movie &)> &onRow) {
+  vector<Movie> page;
+  int afterId = 0;
+  do {
+    if (!listMoviesPage(afterId, LIST_PAGE_ROWS, page)) return false;
+    for (const Movie &movie : page) {
+      if (!onRow(movie)) return false;
+    }
+    if (!page.empty()) afterId = page.back().id;
+  } while (page.size() == LIST_PAGE_ROWS);
+  return true;
+}
+
+// Read one keyset page: up to limit movies with id > afterId, walked along
+// the primary key so the cost does not depend on how deep the page is
+bool DBHandler::listMoviesPage(int afterId, int limit, vector<Movie> &movies) {
+  return execute("ListMoviesPage", true, [&](DBConnection &conn) {
+    sql::PreparedStatement* pstmt = conn.statement(Stmt::ListPage);
+    pstmt->setInt(1, afterId);
+    pstmt->setInt(2, limit);
     unique_ptr<sql::ResultSet> res(pstmt->executeQuery());
-    
-    jsoncons::json arr = jsoncons::json::array();
+
+    movies.clear();
     while (res->next()) {
-      jsoncons::json movie;
-      movie["id"] = res->getInt("id");
-      movie["title"] = string(res->getString("title"));
-      movie["genre"] = string(res->getString("genre"));
-      movie["release_year"] = res->getInt("release_year");
-      movie["rating"] = static_cast<double>(res->getDouble("rating"));
-      arr.push_back(movie);
+      movies.push_back(movie_from_row(*res));
     }
-
-    movieListJson = arr.to_string();
     return true;
-  } catch (sql::SQLException &e) {
-    cerr << "ListMovies failed: " << e.what() << endl;
-    movieListJson = "[]";
-    return false;
-  }
+  });
 }
 
-// Find a movie by its title from database
-bool DBHandler::searchMovie(const string &title, string &movieJson) {
-  sql::Connection* con = getThreadConnection();
-  if (!con) return false;
-
-  try {
-    unique_ptr<sql::PreparedStatement> pstmt {
-      con->prepareStatement(
-        "SELECT * FROM movies WHERE LOWER(title) LIKE LOWER(?)"
-      )
-    };
+// Find movies whose title contains title, and their ids
+bool DBHandler::searchMovie(const string &title, string &movieJson, vector<int> &ids) {
+  bool ok = execute("SearchMovie", true, [&](DBConnection &conn) {
+    sql::PreparedStatement* pstmt = conn.statement(Stmt::SearchTitle);
     string searchPattern = "%" + title + "%";
     pstmt->setString(1, searchPattern);
 
     unique_ptr<sql::ResultSet> res(pstmt->executeQuery());
 
-    jsoncons::json movieArray = jsoncons::json::array();
+    movieJson = "[";
+    ids.clear();
     while (res->next()) {
-      jsoncons::json movieObj;
-      movieObj["id"] = res->getInt("id");
-      movieObj["title"] = string(res->getString("title"));
-      movieObj["genre"] = string(res->getString("genre"));
-      movieObj["release_year"] = res->getInt("release_year");
-      movieObj["rating"] = static_cast<double>(res->getDouble("rating"));
-      movieArray.push_back(movieObj);
+      Movie movie = movie_from_row(*res);
+      if (movieJson.size() > 1) movieJson += ',';
+      append_movie_json(movieJson, movie);
+      ids.push_back(movie.id);
     }
-    movieJson = movieArray.to_string();
+    movieJson += ']';
     return true;
-
-  } catch(sql::SQLException& e) {
-    cerr << "SearchMovie failed: " << e.what() << endl;
-    movieJson = "{}";
-    return false;
-  }
+  });
+  if (!ok) movieJson = "{}";
+  return ok;
 }
 
-// Update rating of a movie
-bool DBHandler::updateRating(int id, double rating, string &title, string &movieJson) {
-  sql::Connection* con = getThreadConnection();
-  if (!con) return false;
-
-  try {
-    unique_ptr<sql::PreparedStatement> pstmt {
-      con->prepareStatement(
-        "UPDATE movies SET rating = ? WHERE id = ?"
-      )
-    };
+// Update rating of a movie. Group committed with concurrent writes.
+bool DBHandler::updateRating(int id, double rating, Movie &updated) {
+  return combineWrite("UpdateRating", [&](DBConnection &conn) {
+    sql::PreparedStatement* pstmt = conn.statement(Stmt::UpdateRating);
     pstmt->setDouble(1, rating);
     pstmt->setInt(2, id);
     int affected = pstmt->executeUpdate();
     if (affected == 0) {
-      cerr << "No movie found with id " << id << endl;
+      LOG_WARN("No movie found with id %d", id);
       return false;
     }
-    unique_ptr<sql::PreparedStatement> getpstmt {
-      con->prepareStatement(
-        "SELECT * FROM movies WHERE id = ?"
-      )
-    };
+    sql::PreparedStatement* getpstmt = conn.statement(Stmt::SelectById);
     getpstmt->setInt(1, id);
     unique_ptr<sql::ResultSet> res(getpstmt->executeQuery());
-    if (res->next()) {
-      jsoncons::json movie;
-      movie["id"] = res->getInt("id");
-      movie["title"] = string(res->getString("title"));
-      movie["genre"] = string(res->getString("genre"));
-      movie["release_year"] = res->getInt("release_year");
-      movie["rating"] = static_cast<double>(res->getDouble("rating"));
-      
-      title = movie["title"].as<string>();
-      movieJson = movie.to_string();
-    }
+    if (res->next()) updated = movie_from_row(*res);
     return true;
-  } catch (sql::SQLException &e) {
-    cerr << "UpdateRating failed: " << e.what() << endl;
-    return false;
-  }
+  });
 }
 
 // Delete a movie from database
 bool DBHandler::deleteMovie(int id, string &title) {
-  sql::Connection* con = getThreadConnection();
-  if (!con) return false;
-  
-  try {
-    unique_ptr<sql::PreparedStatement> titlepstmt {
-      con->prepareStatement(
-        "SELECT title FROM movies WHERE id = ?"
-      )
-    };
+  return execute("DeleteMovie", false, [&](DBConnection &conn) {
+    sql::PreparedStatement* titlepstmt = conn.statement(Stmt::SelectById);
     titlepstmt->setInt(1, id);
     unique_ptr<sql::ResultSet> res(titlepstmt->executeQuery());
     if (res->next()) title = res->getString("title");
     
-    unique_ptr<sql::PreparedStatement> pstmt {
-      con->prepareStatement(
-        "DELETE FROM movies WHERE id = ?"
-      )
-    };
+    sql::PreparedStatement* pstmt = conn.statement(Stmt::DeleteById);
     pstmt->setInt(1, id);
     int affected = pstmt->executeUpdate();
     if (affected == 0) {
-      cerr << "No movie found with id " << id << endl;
+      LOG_WARN("No movie found with id %d", id);
       return false;
     }
     return true;
-  } catch (sql::SQLException &e) {
-    cerr << "DeleteMovie failed: " << e.what() << endl;
-    return false;
-  }
+  });
 }
@@ -3,12 +3,36 @@
 #include <string>
 #include <memory>
 #include <jsoncons/json.hpp>
+#include <functional>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <mutex>
-#include <thread>
-#include <unordered_map>
+#include "connection_pool.h"
+#include "movie.h"
 
 using namespace std;
 
+#define LIST_PAGE_ROWS 1000         // rows per keyset page a full listing is read in
+#define GROUP_COMMIT_MAX_WRITES 64  // single-movie writes committed in one transaction at most
+#define GROUP_COMMIT_WINDOW_US 0    // how long a batch waits for more writes before it runs
+
+// Group commit of concurrent /add-movie and /update-rating writes
+struct GroupCommitConfig {
+  size_t maxWrites = GROUP_COMMIT_MAX_WRITES;  // 1 disables group commit
+  chrono::microseconds window{GROUP_COMMIT_WINDOW_US};
+};
+
+// Group commit counters
+struct GroupCommitStats {
+  uint64_t batches = 0;    // transactions run by the write combiner
+  uint64_t writes = 0;     // writes in them
+  uint64_t fallbacks = 0;  // batches that failed and were rerun one write at a time
+  uint64_t maxBatch = 0;   // most writes in one transaction
+};
+
 class DBHandler {
   private:
     std::string db_host;
@@ -17,26 +41,46 @@ class DBHandler {
     std::string db_name;
     sql::Driver* driver;
 
-    std::unordered_map<std::thread::id, std::unique_ptr<sql::Connection>> connections;
-    std::mutex connections_mutex;
+    ConnectionPool pool;
+
+    // Write combiner: writes queue up here while a batch runs
+    struct PendingWrite;
+    GroupCommitConfig groupCommit;
+    mutex writeMutex;
+    condition_variable writeCv;
+    deque<PendingWrite *> pendingWrites;
+    bool writeLeader = false;  // a caller is running a batch
+    atomic<uint64_t> groupBatches{0};
+    atomic<uint64_t> groupWrites{0};
+    atomic<uint64_t> groupFallbacks{0};
+    atomic<uint64_t> groupMaxBatch{0};
+
+    unique_ptr<DBConnection> connect();
+
+    template <typename Fn>
+    bool execute(const char *opName, bool idempotent, Fn &&fn);
 
-    static const int MAX_CONNECTIONS = 100;
-    
-    sql::Connection* getThreadConnection();
+    bool combineWrite(const char *opName, function<bool(DBConnection &)> fn);
+    void runWriteBatch(vector<PendingWrite *> &batch);
 
   public:
     DBHandler(const string& host,
         const string& user,
         const string& pass,
-        const string& db);
+        const string& db,
+        const PoolConfig& poolConfig = PoolConfig(),
+        const GroupCommitConfig& groupCommitConfig = GroupCommitConfig());
 
     ~DBHandler();
 
-    bool addMovie(const string &title, const string &genre, int year, double rating);
-    bool listMovies(string &movieJson);
-    bool searchMovie(const string &title, string &movieJson);
-    bool updateRating(int id, double rating, string &title, string &movieJson);
+    bool addMovie(const string &title, const string &genre, int year, double rating, Movie &added);
+    bool addMovies(const vector<Movie> &movies, vector<Movie> &added);
+    bool listMovies(const function<bool(const Movie &)> &onRow);
+    bool listMoviesPage(int afterId, int limit, vector<Movie> &movies);
+    bool searchMovie(const string &title, string &movieJson, vector<int> &ids);
+    bool updateRating(int id, double rating, Movie &updated);
     bool deleteMovie(int id, string &title);
 
-    void cleanupThreadConnection();
+    PoolStats poolStats() const;
+    GroupCommitStats groupCommitStats() const;
 };
\ No newline at end of file
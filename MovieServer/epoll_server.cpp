@@ -0,0 +1,615 @@
+#include "epoll_server.h"
+#include "logger.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <strings.h>
+
+using Clock = chrono::steady_clock;
+
+// parseRequest() results besides an HTTP error status
+#define REQUEST_INCOMPLETE 0
+#define REQUEST_READY 1
+
+// Markers in epoll_event.data.ptr for the listening socket and the wake fd
+static char listenMarker;
+static char wakeMarker;
+
+// Constructor: takes ownership of the handler pool
+EpollServer::EpollServer(size_t reactors, httplib::TaskQueue *handlerPool)
+    : handlers(handlerPool), reactorCount(reactors ? reactors : 1) {}
+
+// Stop serving if still running
+EpollServer::~EpollServer() {
+  stop();
+}
+
+EpollServer &EpollServer::route(const string &method, const string &path, Handler handler) {
+  routes[method][path] = std::move(handler);
+  return *this;
+}
+
+EpollServer &EpollServer::Get(const string &path, Handler handler) {
+  return route("GET", path, std::move(handler));
+}
+
+EpollServer &EpollServer::Post(const string &path, Handler handler) {
+  return route("POST", path, std::move(handler));
+}
+
+EpollServer &EpollServer::Put(const string &path, Handler handler) {
+  return route("PUT", path, std::move(handler));
+}
+
+EpollServer &EpollServer::Delete(const string &path, Handler handler) {
+  return route("DELETE", path, std::move(handler));
+}
+
+// Like httplib's: runs before routing and may answer the request itself
+EpollServer &EpollServer::set_pre_routing_handler(HandlerWithResponse handler) {
+  preRouting = std::move(handler);
+  return *this;
+}
+
+// Bind, start the reactors and block until stop(). Returns false if the
+// socket could not be set up.
+bool EpollServer::listen(const string &host, int port) {
+  addrinfo hints{};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  addrinfo *addr = nullptr;
+  if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addr) != 0) {
+    LOG_ERROR("Cannot resolve %s", host.c_str());
+    return false;
+  }
+
+  listenFd = socket(addr->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int yes = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  bool bound = listenFd >= 0 && ::bind(listenFd, addr->ai_addr, addr->ai_addrlen) == 0 &&
+               ::listen(listenFd, EPOLL_LISTEN_BACKLOG) == 0;
+  freeaddrinfo(addr);
+  if (!bound) {
+    LOG_ERROR("Cannot listen on %s:%d: %s", host.c_str(), port, strerror(errno));
+    if (listenFd >= 0) close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+
+  // Every reactor watches the listening socket; EPOLLEXCLUSIVE wakes only
+  // one of them per incoming connection
+  running = true;
+  for (size_t i = 0; i < reactorCount; i++) {
+    auto r = make_unique<Reactor>();
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    r->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r->spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = &listenMarker;
+    epoll_ctl(r->epfd, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.events = EPOLLIN;
+    ev.data.ptr = &wakeMarker;
+    epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->wakeFd, &ev);
+    reactors.push_back(std::move(r));
+  }
+  for (auto &r : reactors) r->loop = thread(&EpollServer::runReactor, this, ref(*r));
+
+  for (auto &r : reactors) r->loop.join();
+  // Requests still queued run to completion; their responses have nowhere to go
+  handlers->shutdown();
+  for (auto &r : reactors) {
+    for (auto &kv : r->connections) close(kv.first);
+    openConnections.fetch_sub(r->connections.size(), memory_order_relaxed);
+    close(r->epfd);
+    close(r->wakeFd);
+    if (r->spareFd >= 0) close(r->spareFd);
+  }
+  reactors.clear();
+  close(listenFd);
+  listenFd = -1;
+  return true;
+}
+
+// Make listen() return: the reactors close their connections and exit
+void EpollServer::stop() {
+  if (!running.exchange(false)) return;
+  uint64_t one = 1;
+  for (auto &r : reactors) {
+    if (write(r->wakeFd, &one, sizeof(one)) < 0) LOG_WARN("Reactor wake failed: %s", strerror(errno));
+  }
+}
+
+// Get front end counters
+EpollServerStats EpollServer::stats() const {
+  EpollServerStats s;
+  s.openConnections = openConnections.load(memory_order_relaxed);
+  s.accepted = accepted.load(memory_order_relaxed);
+  s.requests = requests.load(memory_order_relaxed);
+  s.refused = refused.load(memory_order_relaxed);
+  return s;
+}
+
+// Event loop of one reactor. Connections are registered one-shot, so an
+// event disarms its connection until the reactor re-arms it for the next
+// read or write; a connection whose request is with the pool stays disarmed.
+void EpollServer::runReactor(Reactor &r) {
+  epoll_event events[EPOLL_MAX_EVENTS];
+  Clock::time_point lastSweep = Clock::now();
+
+  while (running) {
+    int n = epoll_wait(r.epfd, events, EPOLL_MAX_EVENTS, 1000);
+    for (int i = 0; i < n; i++) {
+      void *tag = events[i].data.ptr;
+      if (tag == &listenMarker) {
+        acceptAll(r);
+      } else if (tag == &wakeMarker) {
+        uint64_t count;
+        while (read(r.wakeFd, &count, sizeof(count)) > 0) {}
+        vector<Completion> done;
+        {
+          lock_guard<mutex> lock(r.mtx);
+          done.swap(r.done);
+        }
+        for (Completion &completion : done) complete(r, std::move(completion));
+      } else {
+        Connection *c = static_cast<Connection *>(tag);
+        if (events[i].events & EPOLLOUT) {
+          onWritable(r, c);
+        } else {
+          onReadable(r, c);
+        }
+      }
+    }
+
+    if (Clock::now() - lastSweep >= chrono::seconds(1)) {
+      closeIdle(r);
+      if (r.acceptPaused) resumeAccepting(r);
+      lastSweep = Clock::now();
+    }
+  }
+
+  // A handler thread may still be writing to a busy connection, so it is
+  // only shut down here; listen() closes it once the pool has stopped
+  vector<Connection *> open;
+  for (auto &kv : r.connections) open.push_back(kv.second.get());
+  for (Connection *c : open) {
+    if (c->busy) {
+      ::shutdown(c->fd, SHUT_RDWR);
+    } else {
+      closeConnection(r, c);
+    }
+  }
+}
+
+// Accept every pending connection and register it with this reactor
+void EpollServer::acceptAll(Reactor &r) {
+  while (true) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    int fd = accept4(listenFd, reinterpret_cast<sockaddr *>(&addr), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EMFILE || errno == ENFILE) {
+        if (refuseConnection(r)) continue;
+        return;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) LOG_WARN("accept failed: %s", strerror(errno));
+      return;
+    }
+
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    auto c = make_unique<Connection>();
+    c->fd = fd;
+    char ip[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    c->remoteAddr = ip;
+    c->remotePort = ntohs(addr.sin_port);
+    c->lastActive = Clock::now();
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = c.get();
+    if (epoll_ctl(r.epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      close(fd);
+      continue;
+    }
+    r.connections.emplace(fd, std::move(c));
+    accepted.fetch_add(1, memory_order_relaxed);
+    openConnections.fetch_add(1, memory_order_relaxed);
+  }
+}
+
+// Out of file descriptors. The pending connection keeps the level-triggered
+// listen fd readable, so leaving it queued would spin the reactor. Give up
+// the reserve descriptor to accept it and close it at once. Without a
+// reserve, stop watching the listen fd until a descriptor frees up. Returns
+// true if a connection was refused and accepting can go on.
+bool EpollServer::refuseConnection(Reactor &r) {
+  if (r.spareFd >= 0) {
+    close(r.spareFd);
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    int err = errno;
+    if (fd >= 0) close(fd);
+    r.spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      refused.fetch_add(1, memory_order_relaxed);
+      return true;
+    }
+    if (err == EAGAIN || err == EWOULDBLOCK) return false;
+  }
+  if (!r.acceptPaused) {
+    LOG_WARN("Out of file descriptors, not accepting connections until one closes");
+    epoll_ctl(r.epfd, EPOLL_CTL_DEL, listenFd, nullptr);
+    r.acceptPaused = true;
+  }
+  return false;
+}
+
+// Watch the listen fd again, and take back the reserve descriptor, once
+// descriptors are available
+void EpollServer::resumeAccepting(Reactor &r) {
+  if (r.spareFd < 0) r.spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  if (!r.acceptPaused || r.spareFd < 0) return;
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+  ev.data.ptr = &listenMarker;
+  if (epoll_ctl(r.epfd, EPOLL_CTL_ADD, listenFd, &ev) == 0) r.acceptPaused = false;
+}
+
+// Re-enable a one-shot connection for the given events
+void EpollServer::rearm(Reactor &r, Connection *c, uint32_t events) {
+  epoll_event ev{};
+  ev.events = events | EPOLLRDHUP | EPOLLONESHOT;
+  ev.data.ptr = c;
+  if (epoll_ctl(r.epfd, EPOLL_CTL_MOD, c->fd, &ev) < 0) closeConnection(r, c);
+}
+
+// Unregister, close and free a connection
+void EpollServer::closeConnection(Reactor &r, Connection *c) {
+  epoll_ctl(r.epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+  close(c->fd);
+  openConnections.fetch_sub(1, memory_order_relaxed);
+  r.connections.erase(c->fd);
+  if (r.acceptPaused || r.spareFd < 0) resumeAccepting(r);
+}
+
+// Close keep-alive connections that have been idle too long
+void EpollServer::closeIdle(Reactor &r) {
+  Clock::time_point cutoff = Clock::now() - chrono::seconds(EPOLL_IDLE_TIMEOUT_SEC);
+  vector<Connection *> idle;
+  for (auto &kv : r.connections) {
+    Connection *c = kv.second.get();
+    if (!c->busy && c->out.empty() && c->lastActive < cutoff) idle.push_back(c);
+  }
+  for (Connection *c : idle) closeConnection(r, c);
+}
+
+// Read everything available, then parse what has arrived
+void EpollServer::onReadable(Reactor &r, Connection *c) {
+  char buf[EPOLL_READ_CHUNK];
+  while (true) {
+    ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      c->in.append(buf, static_cast<size_t>(n));
+      continue;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    // Peer closed (or the socket failed): nothing more to answer
+    closeConnection(r, c);
+    return;
+  }
+  c->lastActive = Clock::now();
+  processInput(r, c);
+}
+
+// Dispatch the request at the front of the input if it is complete,
+// otherwise wait for more bytes
+void EpollServer::processInput(Reactor &r, Connection *c) {
+  httplib::Request req;
+  bool keepAlive = true;
+  int result = parseRequest(*c, req, keepAlive);
+  if (result == REQUEST_INCOMPLETE) {
+    rearm(r, c, EPOLLIN);
+  } else if (result == REQUEST_READY) {
+    dispatch(r, c, std::move(req), keepAlive);
+  } else {
+    respondError(r, c, result);
+  }
+}
+
+// Case-insensitive comparison of a header value
+static bool header_is(const httplib::Request &req, const char *name, const char *value) {
+  return strcasecmp(req.get_header_value(name).c_str(), value) == 0;
+}
+
+// Parse one request off the front of c.in into req. Returns
+// REQUEST_INCOMPLETE until all of it has arrived, REQUEST_READY once it
+// has been consumed, or the HTTP status to reject it with.
+int EpollServer::parseRequest(Connection &c, httplib::Request &req, bool &keepAlive) {
+  if (c.expected && c.in.size() < c.expected) return REQUEST_INCOMPLETE;
+
+  size_t headerEnd = c.in.find("\r\n\r\n");
+  if (headerEnd == string::npos) return c.in.size() > EPOLL_MAX_HEADER_BYTES ? 431 : REQUEST_INCOMPLETE;
+  if (headerEnd > EPOLL_MAX_HEADER_BYTES) return 431;
+
+  // Request line: METHOD SP target SP HTTP/1.x
+  size_t lineEnd = c.in.find("\r\n");
+  string line = c.in.substr(0, lineEnd);
+  size_t sp1 = line.find(' ');
+  size_t sp2 = sp1 == string::npos ? string::npos : line.find(' ', sp1 + 1);
+  if (sp2 == string::npos) return 400;
+  req.method = line.substr(0, sp1);
+  req.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  req.version = line.substr(sp2 + 1);
+  if (req.version != "HTTP/1.1" && req.version != "HTTP/1.0") return 505;
+
+  // Header fields
+  size_t pos = lineEnd + 2;
+  while (pos < headerEnd) {
+    size_t end = c.in.find("\r\n", pos);
+    size_t colon = c.in.find(':', pos);
+    if (colon == string::npos || colon >= end || colon == pos) return 400;
+    size_t valueBegin = colon + 1;
+    while (valueBegin < end && (c.in[valueBegin] == ' ' || c.in[valueBegin] == '\t')) valueBegin++;
+    size_t valueEnd = end;
+    while (valueEnd > valueBegin && (c.in[valueEnd - 1] == ' ' || c.in[valueEnd - 1] == '\t')) valueEnd--;
+    req.headers.emplace(c.in.substr(pos, colon - pos), c.in.substr(valueBegin, valueEnd - valueBegin));
+    pos = end + 2;
+  }
+
+  // Body, sized by Content-Length only
+  if (req.has_header("Transfer-Encoding")) return 501;
+  size_t bodyBytes = 0;
+  if (req.has_header("Content-Length")) {
+    const string value = req.get_header_value("Content-Length");
+    if (value.empty() || value.find_first_not_of("0123456789") != string::npos || value.size() > 18) return 400;
+    bodyBytes = stoull(value);
+    if (bodyBytes > EPOLL_MAX_BODY_BYTES) return 413;
+  }
+  size_t total = headerEnd + 4 + bodyBytes;
+  if (c.in.size() < total) {
+    c.expected = total;
+    return REQUEST_INCOMPLETE;
+  }
+  req.body = c.in.substr(headerEnd + 4, bodyBytes);
+  c.in.erase(0, total);
+  c.expected = 0;
+
+  // Same path and parameter decoding as httplib::Server
+  size_t query = req.target.find('?');
+  req.path = httplib::decode_path_component(req.target.substr(0, query));
+  if (query != string::npos) {
+    httplib::detail::parse_query_text(req.target.data() + query + 1, req.target.size() - query - 1, req.params);
+  }
+  if (req.get_header_value("Content-Type").find("application/x-www-form-urlencoded") == 0 &&
+      req.body.size() <= CPPHTTPLIB_FORM_URL_ENCODED_PAYLOAD_MAX_LENGTH) {
+    httplib::detail::parse_query_text(req.body, req.params);
+  }
+
+  keepAlive = req.version == "HTTP/1.1" ? !header_is(req, "Connection", "close")
+                                        : header_is(req, "Connection", "keep-alive");
+  req.remote_addr = c.remoteAddr;
+  req.remote_port = c.remotePort;
+  req.is_connection_closed = []() { return false; };
+  return REQUEST_READY;
+}
+
+// Hand a complete request to the pool. The connection stays disarmed
+// until its response comes back.
+void EpollServer::dispatch(Reactor &r, Connection *c, httplib::Request req, bool keepAlive) {
+  requests.fetch_add(1, memory_order_relaxed);
+  c->busy = true;
+  auto shared = make_shared<httplib::Request>(std::move(req));
+  bool queued = handlers->enqueue([this, &r, c, shared, keepAlive]() {
+    bool close = !keepAlive;
+    string bytes;
+    if (!serve(*shared, c->fd, bytes, close)) close = true;
+    {
+      lock_guard<mutex> lock(r.mtx);
+      r.done.push_back(Completion{c, std::move(bytes), close});
+    }
+    uint64_t one = 1;
+    if (write(r.wakeFd, &one, sizeof(one)) < 0) LOG_WARN("Reactor wake failed: %s", strerror(errno));
+  });
+  if (!queued) {
+    c->busy = false;
+    respondError(r, c, 503);
+  }
+}
+
+// Answer a request that never reaches a handler, then close
+void EpollServer::respondError(Reactor &r, Connection *c, int status) {
+  string bytes = "HTTP/1.1 " + to_string(status) + " " + httplib::status_message(status) +
+                 "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  c->in.clear();
+  c->expected = 0;
+  complete(r, Completion{c, std::move(bytes), true});
+}
+
+// Start writing a response on its connection
+void EpollServer::complete(Reactor &r, Completion completion) {
+  Connection *c = completion.conn;
+  c->busy = false;
+  c->out = std::move(completion.bytes);
+  c->outOffset = 0;
+  c->closing = completion.close;
+  onWritable(r, c);
+}
+
+// Write as much of the response as the socket takes. Once it is all out,
+// close or go on with the next request on the connection.
+void EpollServer::onWritable(Reactor &r, Connection *c) {
+  while (c->outOffset < c->out.size()) {
+    ssize_t n = send(c->fd, c->out.data() + c->outOffset, c->out.size() - c->outOffset, MSG_NOSIGNAL);
+    if (n > 0) {
+      c->outOffset += static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      rearm(r, c, EPOLLOUT);
+      return;
+    }
+    closeConnection(r, c);
+    return;
+  }
+
+  if (c->closing) {
+    closeConnection(r, c);
+    return;
+  }
+  string().swap(c->out);
+  c->outOffset = 0;
+  c->lastActive = Clock::now();
+  processInput(r, c);
+}
+
+// Send all of data from a handler thread. The socket is non-blocking, so
+// when it is full wait for it to drain, at most EPOLL_WRITE_TIMEOUT_SEC at
+// a time. The reactor leaves a connection alone while it is busy.
+static bool send_all(int fd, const char *data, size_t size, int flags = 0) {
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL | flags);
+    if (n > 0) {
+      data += n;
+      size -= static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      pollfd p{fd, POLLOUT, 0};
+      if (poll(&p, 1, EPOLL_WRITE_TIMEOUT_SEC * 1000) > 0) continue;
+    }
+    return false;
+  }
+  return true;
+}
+
+// Status line and headers. The body is framed by a Content-Length of
+// length, or with chunked set by Transfer-Encoding, or with neither (length
+// npos) by closing the connection or by having no body.
+static string response_head(const httplib::Response &res, size_t length, bool chunked, bool close) {
+  string out = "HTTP/1.1 " + to_string(res.status) + " " + httplib::status_message(res.status) + "\r\n";
+  for (const auto &header : res.headers) {
+    if (strcasecmp(header.first.c_str(), "Content-Length") == 0 ||
+        strcasecmp(header.first.c_str(), "Connection") == 0 ||
+        strcasecmp(header.first.c_str(), "Transfer-Encoding") == 0) {
+      continue;
+    }
+    out += header.first + ": " + header.second + "\r\n";
+  }
+  if (chunked) {
+    out += "Transfer-Encoding: chunked\r\n";
+  } else if (length != string::npos) {
+    out += "Content-Length: " + to_string(length) + "\r\n";
+  }
+  out += close ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+  return out;
+}
+
+// Write a content provider's response straight to the socket: the head,
+// then each piece of the body as the provider hands it over, without
+// copying it. A provider without a length is sent chunked, or to HTTP/1.0
+// clients delimited by closing the connection. Returns false if the
+// provider or the client failed, and the response is then cut short.
+static bool stream_response(int fd, const httplib::Request &req, httplib::Response &res, bool &close) {
+  bool sized = !res.is_chunked_content_provider_;
+  bool chunked = !sized && req.version == "HTTP/1.1";
+  if (!sized && !chunked) close = true;
+  string head = response_head(res, sized ? res.content_length_ : string::npos, chunked, close);
+  if (!send_all(fd, head.data(), head.size(), MSG_MORE)) return false;
+
+  size_t offset = 0;
+  bool finished = false;
+  bool clientOk = true;
+  httplib::DataSink sink;
+  sink.write = [&](const char *data, size_t length) {
+    if (!clientOk) return false;
+    if (chunked && length > 0) {
+      char prefix[24];
+      int n = snprintf(prefix, sizeof(prefix), "%zx\r\n", length);
+      clientOk = send_all(fd, prefix, static_cast<size_t>(n), MSG_MORE) && send_all(fd, data, length) &&
+                 send_all(fd, "\r\n", 2, MSG_MORE);
+    } else {
+      clientOk = send_all(fd, data, length);
+    }
+    offset += length;
+    return clientOk;
+  };
+  sink.is_writable = [&clientOk]() { return clientOk; };
+  sink.done = [&finished]() { finished = true; };
+  sink.done_with_trailer = [&finished](const httplib::Headers &) { finished = true; };
+
+  bool ok = true;
+  if (sized) {
+    while (ok && offset < res.content_length_) {
+      size_t before = offset;
+      ok = res.content_provider_(offset, res.content_length_ - offset, sink) && clientOk;
+      if (offset == before) ok = false;  // no progress
+    }
+  } else {
+    while (ok && !finished) ok = res.content_provider_(offset, 0, sink) && clientOk;
+    if (ok && chunked) ok = send_all(fd, "0\r\n\r\n", 5);
+  }
+  res.content_provider_success_ = ok;
+  return ok;
+}
+
+// Run the route for a request and produce its response: a plain body is
+// serialized into bytes for the reactor to write, a content provider's is
+// streamed to fd from this thread and bytes is left empty. close is set
+// when the connection must be closed afterwards. Returns false if the
+// response was cut short and the connection has to be dropped.
+bool EpollServer::serve(const httplib::Request &req, int fd, string &bytes, bool &close) {
+  httplib::Response res;
+  bool head = req.method == "HEAD";
+  auto methodRoutes = routes.find(head ? "GET" : req.method);
+  const Handler *handler = nullptr;
+  if (methodRoutes != routes.end()) {
+    auto found = methodRoutes->second.find(req.path);
+    if (found != methodRoutes->second.end()) handler = &found->second;
+  }
+
+  if (preRouting && preRouting(req, res) == httplib::Server::HandlerResponse::Handled) {
+    if (res.status == -1) res.status = 200;
+  } else if (!handler) {
+    res.status = 404;
+  } else {
+    try {
+      (*handler)(req, res);
+      if (res.status == -1) res.status = 200;
+    } catch (const exception &e) {
+      LOG_ERROR("Handler for %s %s threw: %s", req.method.c_str(), req.path.c_str(), e.what());
+      res = httplib::Response();
+      res.status = 500;
+    }
+  }
+
+  // A handler may ask for the connection to be closed after its response
+  if (strcasecmp(res.get_header_value("Connection").c_str(), "close") == 0) close = true;
+
+  bool noBody = res.status == 304 || res.status == 204 || res.status < 200;
+  if (res.content_provider_ && !noBody && !head) return stream_response(fd, req, res, close);
+
+  size_t length = string::npos;
+  if (!noBody) {
+    length = res.content_provider_ ? res.content_length_ : res.body.size();
+    if (res.is_chunked_content_provider_) length = string::npos;
+  }
+  bytes = response_head(res, length, false, close);
+  if (!noBody && !head) bytes += res.body;
+  return true;
+}
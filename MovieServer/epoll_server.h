@@ -0,0 +1,123 @@
+#pragma once
+#include <httplib.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+#define EPOLL_MAX_HEADER_BYTES 8192
+#define EPOLL_MAX_BODY_BYTES (64 * 1024 * 1024)
+#define EPOLL_READ_CHUNK 16384
+#define EPOLL_MAX_EVENTS 256
+#define EPOLL_LISTEN_BACKLOG 1024
+#define EPOLL_IDLE_TIMEOUT_SEC CPPHTTPLIB_KEEPALIVE_TIMEOUT_SECOND  // idle keep-alive connections are closed after
+#define EPOLL_WRITE_TIMEOUT_SEC CPPHTTPLIB_SERVER_WRITE_TIMEOUT_SECOND // a streamed response gives up on a client this slow
+
+// Front end counters
+struct EpollServerStats {
+  size_t openConnections = 0;
+  size_t accepted = 0;
+  size_t requests = 0;
+  size_t refused = 0;  // connections closed unserved for lack of file descriptors
+};
+
+// HTTP/1.1 server where a few reactor threads own every socket through
+// epoll and parse requests, and only complete requests reach the handler
+// pool. An idle keep-alive connection costs a buffer, not a thread.
+//
+// Routes are registered with the same Get/Post/Put/Delete calls and the
+// same handlers as httplib::Server (exact paths only), and a pre-routing
+// handler can answer a request before its route does. The handler pool
+// runs the handler. A plain body is serialized and handed back to the
+// connection's reactor to write. A content provider's body is streamed by
+// the handler thread straight to the socket as the provider produces it
+// (chunked unless its length is known), waiting for the socket to drain
+// when it is full, so it is never buffered whole. Requests on one
+// connection are answered in order, one at a time.
+class EpollServer {
+  public:
+    using Handler = httplib::Server::Handler;
+    using HandlerWithResponse = httplib::Server::HandlerWithResponse;
+
+  private:
+    struct Connection {
+      int fd = -1;
+      string remoteAddr;
+      int remotePort = -1;
+      string in;                 // read, not yet parsed
+      size_t expected = 0;       // bytes the request at the front needs, once its headers are in
+      string out;                // response being written
+      size_t outOffset = 0;
+      bool busy = false;         // a request is with the handler pool
+      bool closing = false;      // close once out is written
+      chrono::steady_clock::time_point lastActive;
+    };
+
+    // A response coming back from the handler pool
+    struct Completion {
+      Connection *conn;
+      string bytes;
+      bool close;
+    };
+
+    // One epoll loop and the connections it accepted
+    struct Reactor {
+      int epfd = -1;
+      int wakeFd = -1;
+      int spareFd = -1;            // reserve descriptor, given up to refuse connections when out of fds
+      bool acceptPaused = false;   // listen fd unwatched until a descriptor frees up
+      thread loop;
+      mutex mtx;
+      vector<Completion> done;
+      unordered_map<int, unique_ptr<Connection>> connections;
+    };
+
+    unordered_map<string, unordered_map<string, Handler>> routes;  // method -> path -> handler
+    HandlerWithResponse preRouting;
+    unique_ptr<httplib::TaskQueue> handlers;
+    vector<unique_ptr<Reactor>> reactors;
+    size_t reactorCount;
+    int listenFd = -1;
+    atomic<bool> running{false};
+    atomic<size_t> openConnections{0};
+    atomic<size_t> accepted{0};
+    atomic<size_t> requests{0};
+    atomic<size_t> refused{0};
+
+    void runReactor(Reactor &r);
+    void acceptAll(Reactor &r);
+    bool refuseConnection(Reactor &r);
+    void resumeAccepting(Reactor &r);
+    void onReadable(Reactor &r, Connection *c);
+    void onWritable(Reactor &r, Connection *c);
+    void processInput(Reactor &r, Connection *c);
+    int parseRequest(Connection &c, httplib::Request &req, bool &keepAlive);
+    void dispatch(Reactor &r, Connection *c, httplib::Request req, bool keepAlive);
+    void respondError(Reactor &r, Connection *c, int status);
+    void complete(Reactor &r, Completion completion);
+    void rearm(Reactor &r, Connection *c, uint32_t events);
+    void closeConnection(Reactor &r, Connection *c);
+    void closeIdle(Reactor &r);
+    bool serve(const httplib::Request &req, int fd, string &bytes, bool &close);
+    EpollServer &route(const string &method, const string &path, Handler handler);
+
+  public:
+    EpollServer(size_t reactors, httplib::TaskQueue *handlerPool);
+    ~EpollServer();
+
+    EpollServer &Get(const string &path, Handler handler);
+    EpollServer &Post(const string &path, Handler handler);
+    EpollServer &Put(const string &path, Handler handler);
+    EpollServer &Delete(const string &path, Handler handler);
+    EpollServer &set_pre_routing_handler(HandlerWithResponse handler);
+
+    bool listen(const string &host, int port);
+    void stop();
+    EpollServerStats stats() const;
+};
@@ -0,0 +1,243 @@
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+atomic<int> Logger::runtimeLevel{LOG_LEVEL_TRACE};
+
+namespace {
+
+// Plain globals so they stay valid while statics are being destroyed
+atomic<bool> drainerStopped{false};
+atomic<uint64_t> droppedRecords{0};
+
+struct LogRecord {
+  int64_t timeUs;
+  LogLevel level;
+  uint32_t length;
+  char text[LOG_RECORD_SIZE];
+};
+
+// Single-producer single-consumer ring owned by one writer thread
+struct LogRing {
+  LogRecord slots[LOG_RING_SLOTS];
+  atomic<size_t> head{0};  // next slot the writer fills
+  atomic<size_t> tail{0};  // next slot the drainer reads
+  atomic<bool> retired{false};
+
+  LogRecord *reserve() {
+    size_t h = head.load(memory_order_relaxed);
+    if (h - tail.load(memory_order_acquire) >= LOG_RING_SLOTS) return nullptr;
+    return &slots[h % LOG_RING_SLOTS];
+  }
+  // Publish the reserved slot, returns the number of records now pending
+  size_t commit() {
+    size_t h = head.load(memory_order_relaxed) + 1;
+    head.store(h, memory_order_release);
+    return h - tail.load(memory_order_relaxed);
+  }
+  bool empty() const { return tail.load(memory_order_relaxed) == head.load(memory_order_acquire); }
+};
+
+class LogDrainer {
+  private:
+    mutex mtx;
+    condition_variable cv;
+    vector<shared_ptr<LogRing>> rings;
+    thread worker;
+    bool stopping = false;
+    uint64_t flushRequested = 0;
+    uint64_t flushCompleted = 0;
+
+    void drainOnce(vector<LogRecord> &batch) {
+      vector<shared_ptr<LogRing>> snapshot;
+      {
+        lock_guard<mutex> lock(mtx);
+        // Forget rings of exited threads once they have been emptied
+        rings.erase(remove_if(rings.begin(), rings.end(), [](const shared_ptr<LogRing> &r) {
+                      return r->retired.load(memory_order_acquire) && r->empty();
+                    }), rings.end());
+        snapshot = rings;
+      }
+
+      batch.clear();
+      for (auto &ring : snapshot) {
+        size_t t = ring->tail.load(memory_order_relaxed);
+        size_t h = ring->head.load(memory_order_acquire);
+        for (; t != h; t++) batch.push_back(ring->slots[t % LOG_RING_SLOTS]);
+        ring->tail.store(t, memory_order_release);
+      }
+      if (batch.empty()) return;
+
+      // Interleave threads in time order
+      stable_sort(batch.begin(), batch.end(), [](const LogRecord &a, const LogRecord &b) {
+        return a.timeUs < b.timeUs;
+      });
+      for (const LogRecord &record : batch) emit(record);
+      fflush(stdout);
+      fflush(stderr);
+    }
+
+  public:
+    LogDrainer() {
+      worker = thread([this]() { run(); });
+    }
+
+    ~LogDrainer() {
+      {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+      }
+      cv.notify_one();
+      worker.join();
+      drainerStopped = true;
+    }
+
+    shared_ptr<LogRing> registerRing() {
+      auto ring = make_shared<LogRing>();
+      lock_guard<mutex> lock(mtx);
+      rings.push_back(ring);
+      return ring;
+    }
+
+    void wake() { cv.notify_one(); }
+
+    void flush() {
+      unique_lock<mutex> lock(mtx);
+      uint64_t ticket = ++flushRequested;
+      cv.notify_all();
+      cv.wait(lock, [&]() { return flushCompleted >= ticket || stopping; });
+    }
+
+    void run() {
+      vector<LogRecord> batch;
+      batch.reserve(LOG_RING_SLOTS);
+      unique_lock<mutex> lock(mtx);
+      while (true) {
+        cv.wait_for(lock, chrono::milliseconds(5), [&]() {
+          return stopping || flushRequested > flushCompleted;
+        });
+        bool stop = stopping;
+        uint64_t ticket = flushRequested;
+        lock.unlock();
+        drainOnce(batch);
+        lock.lock();
+        flushCompleted = ticket;
+        cv.notify_all();
+        if (stop) break;
+      }
+      lock.unlock();
+      drainOnce(batch);
+    }
+
+    static void emit(const LogRecord &record) {
+      static const char *names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR"};
+      time_t secs = static_cast<time_t>(record.timeUs / 1000000);
+      tm local;
+      localtime_r(&secs, &local);
+      char stamp[32];
+      strftime(stamp, sizeof(stamp), "%H:%M:%S", &local);
+
+      FILE *out = record.level >= LogLevel::Warn ? stderr : stdout;
+      fprintf(out, "[%s.%03d] [%s] %.*s\n", stamp, static_cast<int>(record.timeUs / 1000 % 1000),
+              names[static_cast<int>(record.level)], static_cast<int>(record.length), record.text);
+    }
+};
+
+LogDrainer &drainer() {
+  static LogDrainer instance;
+  return instance;
+}
+
+// Per-thread handle, marks the ring retired when the thread exits
+struct ThreadRing {
+  shared_ptr<LogRing> ring;
+  ~ThreadRing() {
+    if (ring) ring->retired.store(true, memory_order_release);
+  }
+};
+
+thread_local ThreadRing threadRing;
+
+int64_t nowUs() {
+  return chrono::duration_cast<chrono::microseconds>(
+    chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+// Change the runtime log level (records below it are skipped before formatting)
+void Logger::setLevel(LogLevel level) {
+  runtimeLevel.store(static_cast<int>(level), memory_order_relaxed);
+}
+
+LogLevel Logger::level() {
+  return static_cast<LogLevel>(runtimeLevel.load(memory_order_relaxed));
+}
+
+// Parse a level name such as "info" or "error"
+bool Logger::parseLevel(const string &name, LogLevel &level) {
+  static const pair<const char *, LogLevel> names[] = {
+    {"trace", LogLevel::Trace}, {"debug", LogLevel::Debug}, {"info", LogLevel::Info},
+    {"warn", LogLevel::Warn}, {"error", LogLevel::Error}, {"off", LogLevel::Off}};
+  for (const auto &entry : names) {
+    if (name == entry.first) {
+      level = entry.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Format a record into the calling thread's ring, never blocks: when the
+// ring is full the record is dropped and counted
+void Logger::write(LogLevel level, const char *fmt, ...) {
+  // After shutdown (static destruction) fall back to writing synchronously
+  bool direct = drainerStopped.load(memory_order_acquire);
+
+  LogRecord scratch;
+  LogRecord *record = &scratch;
+  if (!direct) {
+    if (!threadRing.ring) threadRing.ring = drainer().registerRing();
+    record = threadRing.ring->reserve();
+    if (!record) {
+      droppedRecords.fetch_add(1, memory_order_relaxed);
+      drainer().wake();
+      return;
+    }
+  }
+
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(record->text, sizeof(record->text), fmt, args);
+  va_end(args);
+  record->length = n < 0 ? 0 : min<uint32_t>(n, sizeof(record->text) - 1);
+  record->level = level;
+  record->timeUs = nowUs();
+
+  if (direct) {
+    LogDrainer::emit(*record);
+    return;
+  }
+  size_t pending = threadRing.ring->commit();
+  if (level >= LogLevel::Error || pending == LOG_RING_SLOTS / 2) drainer().wake();
+}
+
+// Block until everything logged so far has been written out
+void Logger::flush() {
+  if (!drainerStopped.load(memory_order_acquire)) drainer().flush();
+}
+
+// Number of records dropped because a thread's ring was full
+uint64_t Logger::droppedCount() {
+  return droppedRecords.load(memory_order_relaxed);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Numeric log levels, usable from the preprocessor
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF 5
+
+// Lowest level compiled into the binary, statements below it are removed
+// entirely (set with -DLOG_COMPILE_LEVEL=LOG_LEVEL_INFO etc.)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_TRACE
+#endif
+
+#define LOG_RING_SLOTS 512   // records buffered per thread
+#define LOG_RECORD_SIZE 240  // max formatted message length, longer ones are truncated
+
+enum class LogLevel : int {
+  Trace = LOG_LEVEL_TRACE,
+  Debug = LOG_LEVEL_DEBUG,
+  Info = LOG_LEVEL_INFO,
+  Warn = LOG_LEVEL_WARN,
+  Error = LOG_LEVEL_ERROR,
+  Off = LOG_LEVEL_OFF
+};
+
+// Asynchronous logger: each thread formats into its own lock-free ring
+// buffer and a background thread drains all rings to stdout/stderr, so the
+// request path never takes the iostream lock or flushes
+class Logger {
+  private:
+    static atomic<int> runtimeLevel;
+
+  public:
+    static bool enabled(LogLevel level) {
+      return static_cast<int>(level) >= runtimeLevel.load(memory_order_relaxed);
+    }
+
+    static void setLevel(LogLevel level);
+    static LogLevel level();
+    static bool parseLevel(const string &name, LogLevel &level);
+
+    static void write(LogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    static void flush();
+    static uint64_t droppedCount();
+};
+
+#define LOG_AT(compileLevel, level, ...)                                        \
+  do {                                                                          \
+    if ((compileLevel) >= LOG_COMPILE_LEVEL && Logger::enabled(level))          \
+      Logger::write(level, __VA_ARGS__);                                        \
+  } while (0)
+
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, LogLevel::Error, __VA_ARGS__)
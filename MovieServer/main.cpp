@@ -3,40 +3,310 @@
 #include "db.h"
 #include <jsoncons/json.hpp>
 #include "cache.h"
+#include "catalogue.h"
+#include "negative_cache.h"
+#include "content_encoding.h"
+#include "task_queue.h"
+#include "epoll_server.h"
+#include "admission.h"
+#include "logger.h"
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cstdio>
+#include <functional>
+#include <sstream>
 
 #define DEFAULT_URI "tcp://127.0.0.1"
 #define DB_USER "movieuser"
 #define DB_PASS "moviepass"
 #define DB_NAME "movie_store"
-#define CACHE_CAPACITY 1000
+#define CACHE_BUDGET_MB 64     // bytes of keys, values and bookkeeping the cache may hold
+#define LIST_CHUNK_SIZE 16384  // bytes buffered before a chunk of a streamed listing is sent
+#define DEFAULT_PAGE_SIZE 100   // /list-movies page size when only after_id is given
+#define MAX_PAGE_SIZE 1000
+#define SEARCH_TTL_SEC 30       // search results are fresh this long...
+#define SEARCH_STALE_SEC 300    // ...then served stale this much longer while refreshed
+#define NEGATIVE_CACHE_ENTRIES 100000  // titles remembered as having no match
+#define NEGATIVE_EMPTY_TTL_MS 10000    // how long "no match" is trusted
+#define NEGATIVE_FAILURE_TTL_MS 1000   // how long a failed search is not retried
+#define DEFAULT_REACTORS 2             // epoll front end event loops
 
 using namespace std;
 using namespace jsoncons;
 
 static string to_lower_ascii(const string &s);
 static string movie_cache_key(const string &title);
+static void set_shared_content(httplib::Response &res, CacheValue body, const string &contentType);
+static void set_cached_content(const httplib::Request &req, httplib::Response &res, Cache &cache,
+                               const string &cacheKey, CacheValue body, uint64_t version,
+                               const string &contentType);
+static bool etag_matches(const httplib::Request &req, uint64_t version);
+static void set_not_modified(httplib::Response &res, uint64_t version);
+static void warm_catalogue(DBHandler &db, Catalogue &catalogue);
+static void stream_movie_list(httplib::Response &res, DBHandler &db, Catalogue &catalogue, Cache &cache);
+static void serve_movie_page(const httplib::Request &req, httplib::Response &res,
+                             DBHandler &db, Catalogue &catalogue, Cache &cache);
 
-int main() {
-  httplib::Server svr;
+static uint32_t scan_cost(size_t rows);
+static uint64_t movie_tag(int id);
+static bool is_search_key(const string &key);
+static CacheTags search_tags(const string &cacheKey, const vector<int> &ids);
+static void invalidate_matching_searches(Cache &cache, const vector<string> &titles);
+
+static const CacheExpiry SEARCH_EXPIRY{chrono::seconds(SEARCH_TTL_SEC), chrono::seconds(SEARCH_STALE_SEC)};
+
+// Bodies of negative search results, shared by every response
+static const CacheValue EMPTY_SEARCH_RESULT = make_shared<const string>("[]");
+static const CacheValue FAILED_SEARCH_RESULT = make_shared<const string>("{}");
+
+// Start of every ETag, so tags handed out by an earlier run never match
+static const string ETAG_EPOCH = to_string(
+    chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count());
+static atomic<size_t> notModifiedResponses{0};
+
+static void print_usage();
+template <typename Router>
+static void register_routes(Router &svr, DBHandler &db, Catalogue &catalogue, Cache &cache,
+                            NegativeCache &negativeCache, function<void(ostream &)> serverMetrics);
+
+int main(int argc, char *argv[]) {
+  PoolConfig poolConfig;
+  GroupCommitConfig groupCommitConfig;
+  size_t cacheBudget = (size_t)CACHE_BUDGET_MB * 1024 * 1024;
+  EvictionPolicyKind cachePolicy = EvictionPolicyKind::WTinyLFU;
+  size_t httpThreads = default_worker_count();
+  bool workStealing = true;
+  bool epollFrontend = false;
+  size_t reactors = DEFAULT_REACTORS;
+  AdmissionConfig admissionConfig;
+
+  // Parse command line arguments
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    LogLevel level;
+    if (arg == "--help") {
+      print_usage();
+      return 0;
+    } else if (arg == "--log-level" && i + 1 < argc) {
+      if (!Logger::parseLevel(argv[++i], level)) {
+        cerr << "Unknown log level: " << argv[i] << "\n";
+        print_usage();
+        return 1;
+      }
+      Logger::setLevel(level);
+    } else if (arg == "--quiet") {
+      Logger::setLevel(LogLevel::Warn);  // drop per-request tracing, keep warnings and errors
+    } else if (arg == "--db-pool-min" && i + 1 < argc) {
+      poolConfig.minSize = stoul(argv[++i]);
+    } else if (arg == "--db-pool-max" && i + 1 < argc) {
+      poolConfig.maxSize = stoul(argv[++i]);
+    } else if (arg == "--db-pool-timeout" && i + 1 < argc) {
+      poolConfig.acquireTimeout = chrono::milliseconds(stoi(argv[++i]));
+    } else if (arg == "--group-commit-max" && i + 1 < argc) {
+      groupCommitConfig.maxWrites = stoul(argv[++i]);
+    } else if (arg == "--group-commit-us" && i + 1 < argc) {
+      groupCommitConfig.window = chrono::microseconds(stoi(argv[++i]));
+    } else if (arg == "--cache-mb" && i + 1 < argc) {
+      cacheBudget = stoul(argv[++i]) * 1024 * 1024;
+    } else if (arg == "--cache-policy" && i + 1 < argc) {
+      string name = argv[++i];
+      if (name == "lru") {
+        cachePolicy = EvictionPolicyKind::LRU;
+      } else if (name == "tinylfu") {
+        cachePolicy = EvictionPolicyKind::WTinyLFU;
+      } else if (name == "gds") {
+        cachePolicy = EvictionPolicyKind::GreedyDual;
+      } else {
+        cerr << "Unknown cache policy: " << name << "\n";
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--http-threads" && i + 1 < argc) {
+      httpThreads = max<size_t>(1, stoul(argv[++i]));
+    } else if (arg == "--task-queue" && i + 1 < argc) {
+      string name = argv[++i];
+      if (name == "stealing") {
+        workStealing = true;
+      } else if (name == "pool") {
+        workStealing = false;
+      } else {
+        cerr << "Unknown task queue: " << name << "\n";
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--frontend" && i + 1 < argc) {
+      string name = argv[++i];
+      if (name == "epoll") {
+        epollFrontend = true;
+      } else if (name == "httplib") {
+        epollFrontend = false;
+      } else {
+        cerr << "Unknown frontend: " << name << "\n";
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--reactors" && i + 1 < argc) {
+      reactors = max<size_t>(1, stoul(argv[++i]));
+    } else if (arg == "--queue-target-ms" && i + 1 < argc) {
+      admissionConfig.target = chrono::milliseconds(stoi(argv[++i]));
+    } else if (arg == "--queue-interval-ms" && i + 1 < argc) {
+      admissionConfig.interval = chrono::milliseconds(max(1, stoi(argv[++i])));
+    } else if (arg == "--max-queued" && i + 1 < argc) {
+      admissionConfig.maxQueued = stoul(argv[++i]);
+    }
+  }
+
+  // Work is handed to HTTP workers through a work-stealing queue (or
+  // httplib's own single-queue ThreadPool), sized at runtime. With the
+  // httplib front end a job is a whole connection, with epoll one request.
+  // Unless disabled, jobs that waited too long in it are answered with 503.
+  bool admissionControl = admissionConfig.target.count() > 0;
+  AdmissionController admission(admissionConfig);
+  atomic<WorkStealingQueue *> stealingQueue{nullptr};
+  auto newTaskQueue = [httpThreads, workStealing, admissionControl, &admission,
+                       &stealingQueue]() -> httplib::TaskQueue * {
+    httplib::TaskQueue *queue;
+    if (workStealing) {
+      WorkStealingQueue *stealing = new WorkStealingQueue(httpThreads);
+      stealingQueue = stealing;
+      queue = stealing;
+    } else {
+      queue = new httplib::ThreadPool(httpThreads);
+    }
+    return admissionControl ? new AdmissionQueue(queue, admission) : queue;
+  };
+  auto queueMetrics = [&stealingQueue, &admission](ostream &out) {
+    WorkStealingQueue *queue = stealingQueue.load();
+    if (queue) out << "http_task_steals_total " << queue->stealCount() << "\n";
+    AdmissionStats shed = admission.stats();
+    out << "http_admitted_total " << shed.admitted << "\n";
+    out << "http_shed_total " << shed.shedDelay + shed.shedQueueFull << "\n";
+    out << "http_shed_delay_total " << shed.shedDelay << "\n";
+    out << "http_shed_queue_full_total " << shed.shedQueueFull << "\n";
+    out << "http_overloaded " << shed.overloaded << "\n";
+    out << "http_overloaded_intervals_total " << shed.overloadedIntervals << "\n";
+    out << "http_queue_wait_us_max " << shed.maxSojournUs << "\n";
+  };
 
   const string db_host = DEFAULT_URI;
   const string db_user = DB_USER;
   const string db_pass = DB_PASS;
   const string db_name = DB_NAME;
 
-  DBHandler db(db_host, db_user, db_pass, db_name);
-  Cache cache(CACHE_CAPACITY);
+  DBHandler db(db_host, db_user, db_pass, db_name, poolConfig, groupCommitConfig);
+  // Background cache refreshes use the catalogue and the negative cache, so
+  // both must outlive the cache (its destructor stops the refresh thread)
+  Catalogue catalogue;
+  NegativeCache negativeCache(NEGATIVE_CACHE_ENTRIES, chrono::milliseconds(NEGATIVE_EMPTY_TTL_MS),
+                              chrono::milliseconds(NEGATIVE_FAILURE_TTL_MS));
+  Cache cache(cacheBudget, DEFAULT_CACHE_SHARDS, cachePolicy);
+  warm_catalogue(db, catalogue);
 
+  const char *queueName = workStealing ? "work-stealing queue" : "thread pool";
+  if (epollFrontend) {
+    EpollServer svr(reactors, newTaskQueue());
+    svr.set_pre_routing_handler(shed_overload);
+    register_routes(svr, db, catalogue, cache, negativeCache, [&](ostream &out) {
+      queueMetrics(out);
+      EpollServerStats http = svr.stats();
+      out << "http_connections_open " << http.openConnections << "\n";
+      out << "http_connections_accepted_total " << http.accepted << "\n";
+      out << "http_connections_refused_total " << http.refused << "\n";
+      out << "http_requests_total " << http.requests << "\n";
+    });
+    LOG_INFO("Server running at http://0.0.0.0:8080 with %zu epoll reactors and %zu HTTP workers (%s)",
+             reactors, httpThreads, queueName);
+    svr.listen("0.0.0.0", 8080);
+  } else {
+    httplib::Server svr;
+    svr.new_task_queue = newTaskQueue;
+    svr.set_tcp_nodelay(true);  // don't hold small keep-alive responses back for Nagle
+    svr.set_pre_routing_handler(shed_overload);
+    register_routes(svr, db, catalogue, cache, negativeCache, queueMetrics);
+    LOG_INFO("Server running at http://0.0.0.0:8080 with %zu HTTP workers (%s)", httpThreads, queueName);
+    svr.listen("0.0.0.0", 8080);
+  }
+  Logger::flush();
+}
+
+void print_usage() {
+  cout << "Usage: ./MovieHTTPServer [options]\n";
+  cout << "Options:\n";
+  cout << "  --log-level <level>      trace, debug, info, warn, error or off (default: trace)\n";
+  cout << "  --quiet                  Same as --log-level warn, silences per-request tracing\n";
+  cout << "  --db-pool-min <num>      MySQL connections opened at startup (default: 4)\n";
+  cout << "  --db-pool-max <num>      Max MySQL connections, independent of HTTP workers (default: 16)\n";
+  cout << "  --db-pool-timeout <ms>   Max wait for a free connection before failing (default: 2000)\n";
+  cout << "  --group-commit-max <num> Concurrent adds and rating updates committed in one transaction at most, 1 disables (default: " << GROUP_COMMIT_MAX_WRITES << ")\n";
+  cout << "  --group-commit-us <us>   How long a group commit waits for more writes (default: " << GROUP_COMMIT_WINDOW_US << ")\n";
+  cout << "  --cache-mb <num>         Cache memory budget in MB (default: " << CACHE_BUDGET_MB << ")\n";
+  cout << "  --cache-policy <name>    Cache eviction policy: tinylfu, gds or lru (default: tinylfu)\n";
+  cout << "  --http-threads <num>     HTTP worker threads (default: " << default_worker_count() << ")\n";
+  cout << "  --task-queue <name>      HTTP task queue: stealing or pool, httplib's ThreadPool (default: stealing)\n";
+  cout << "  --frontend <name>        HTTP front end: httplib (thread per connection) or epoll (default: httplib)\n";
+  cout << "  --reactors <num>         Event loops of the epoll front end (default: " << DEFAULT_REACTORS << ")\n";
+  cout << "  --queue-target-ms <ms>   Queueing delay tolerated under overload before shedding with 503, 0 disables (default: " << ADMISSION_TARGET_MS << ")\n";
+  cout << "  --queue-interval-ms <ms> Overload detection window and delay tolerated otherwise (default: " << ADMISSION_INTERVAL_MS << ")\n";
+  cout << "  --max-queued <num>       Shed requests with this many more waiting behind them, 0 = no limit (default: 0)\n";
+  cout << "  --help                   Show this help message\n";
+}
+
+// Register every endpoint on either front end; both take the same handlers.
+// serverMetrics appends the front end's own counters to /metrics.
+template <typename Router>
+static void register_routes(Router &svr, DBHandler &db, Catalogue &catalogue, Cache &cache,
+                            NegativeCache &negativeCache, function<void(ostream &)> serverMetrics) {
   // A test endpoint to check server
   svr.Get("/hi", [](const httplib::Request &, httplib::Response &res) {
     res.set_content("Hello !... This is DECS HTTP server for movie store", "text/plain");
   });
 
+  // Runtime counters in plain "name value" lines
+  svr.Get("/metrics", [&, serverMetrics](const httplib::Request &, httplib::Response &res) {
+    PoolStats pool = db.poolStats();
+    ostringstream out;
+    out << "db_pool_size " << pool.size << "\n";
+    out << "db_pool_max_size " << pool.maxSize << "\n";
+    out << "db_pool_in_use " << pool.inUse << "\n";
+    out << "db_pool_idle " << pool.idle << "\n";
+    out << "db_pool_utilisation " << (pool.maxSize ? (double)pool.inUse / pool.maxSize : 0.0) << "\n";
+    out << "db_pool_acquired_total " << pool.acquired << "\n";
+    out << "db_pool_waited_total " << pool.waited << "\n";
+    out << "db_pool_timeouts_total " << pool.timeouts << "\n";
+    out << "db_pool_created_total " << pool.created << "\n";
+    out << "db_pool_discarded_total " << pool.discarded << "\n";
+    out << "db_pool_wait_us_total " << pool.totalWaitUs << "\n";
+    out << "db_pool_wait_us_max " << pool.maxWaitUs << "\n";
+    GroupCommitStats group = db.groupCommitStats();
+    out << "db_group_commits_total " << group.batches << "\n";
+    out << "db_group_commit_writes_total " << group.writes << "\n";
+    out << "db_group_commit_fallbacks_total " << group.fallbacks << "\n";
+    out << "db_group_commit_max_writes " << group.maxBatch << "\n";
+    out << "cache_entries " << cache.size() << "\n";
+    out << "cache_bytes " << cache.bytes() << "\n";
+    out << "cache_budget_bytes " << cache.budget() << "\n";
+    out << "cache_large_entry_bytes " << cache.largeBytes() << "\n";
+    CacheLoadStats loads = cache.loadStats();
+    out << "cache_loads_total " << loads.loads << "\n";
+    out << "cache_coalesced_total " << loads.coalesced << "\n";
+    out << "cache_refreshes_total " << loads.refreshes << "\n";
+    out << "cache_stale_hits_total " << loads.staleHits << "\n";
+    out << "cache_invalidations_total " << loads.invalidations << "\n";
+    out << "cache_rejected_total " << loads.rejected << "\n";
+    serverMetrics(out);
+    out << "http_not_modified_total " << notModifiedResponses.load(memory_order_relaxed) << "\n";
+    out << "negative_cache_entries " << negativeCache.size() << "\n";
+    out << "negative_cache_hits_total " << negativeCache.hitCount() << "\n";
+    out << "catalogue_movies " << catalogue.size() << "\n";
+    out << "catalogue_version " << catalogue.version() << "\n";
+    out << "log_dropped_total " << Logger::droppedCount() << "\n";
+    res.set_content(out.str(), "text/plain");
+  });
+
   // Add a movie
   svr.Post("/add-movie", [&](const httplib::Request &req, httplib::Response &res) {
-    cout << "Received POST /add-movie request" << endl;
+    LOG_DEBUG("Received POST /add-movie request");
 
     if (!req.has_param("title") || !req.has_param("genre") || !req.has_param("release-year") || !req.has_param("rating")) {
       res.status = 400;
@@ -49,41 +319,94 @@ int main() {
     int year = stoi(req.get_param_value("release-year"));
     double rating = stod(req.get_param_value("rating"));
 
-    if (db.addMovie(title, genre, year, rating)) {
-      json movieJson;
-      movieJson["title"] = title;
-      movieJson["genre"] = genre;
-      movieJson["release_year"] = year;
-      movieJson["rating"] = rating;
-      cache.put(movie_cache_key(title), movieJson.to_string());
-      cache.erase("list_movies");
-      res.set_content("Movie added and cached", "text/plain");
+    Movie added;
+    if (db.addMovie(title, genre, year, rating, added)) {
+      catalogue.upsert(added);
+      // Searches the new title matches are reloaded on their next request,
+      // which puts the full result array back under each search key
+      invalidate_matching_searches(cache, {title});
+      cache.markStale("list_movies");
+      negativeCache.clear();  // the new title may match queries that found nothing
+      res.set_content("Movie added", "text/plain");
     } else {
       res.status = 500;
       res.set_content("Database insertion failed", "text/plain");
     }
   });
 
+  // Add many movies at once: a JSON array of movie objects, or NDJSON
+  svr.Post("/add-movies", [&](const httplib::Request &req, httplib::Response &res) {
+    LOG_DEBUG("Received POST /add-movies request (%zu bytes)", req.body.size());
+
+    vector<Movie> movies;
+    string error;
+    if (!parse_movies(req.body, movies, error)) {
+      res.status = 400;
+      res.set_content(error, "text/plain");
+      return;
+    }
+    if (movies.empty()) {
+      res.status = 400;
+      res.set_content("No movies in request body", "text/plain");
+      return;
+    }
+
+    vector<Movie> stored;
+    if (!db.addMovies(movies, stored)) {
+      res.status = 500;
+      res.set_content("Database insertion failed", "text/plain");
+      return;
+    }
+
+    // One catalogue write and one round of invalidation for the whole batch
+    catalogue.upsert(stored);
+    vector<string> titles;
+    titles.reserve(movies.size());
+    for (const Movie &movie : movies) titles.push_back(movie.title);
+    invalidate_matching_searches(cache, titles);
+    cache.markStale("list_movies");
+    negativeCache.clear();
+    LOG_INFO("Bulk added %zu movies", movies.size());
+    res.set_content("Added " + to_string(movies.size()) + " movies", "text/plain");
+  });
+
   // List all movies
   svr.Get("/list-movies", [&](const httplib::Request &req, httplib::Response &res) {
-    cout << "Received GET /list-movies request" << endl;
+    LOG_DEBUG("Received GET /list-movies request");
 
-    string listData;
-    if (cache.exists("list_movies")) {
-      listData = cache.get("list_movies");
-    } else {
-      if (db.listMovies(listData)) {
-        cache.put("list_movies", listData);
-      }
+    if (req.has_param("limit") || req.has_param("after_id")) {
+      serve_movie_page(req, res, db, catalogue, cache);
+      return;
+    }
+
+    // The listing's ETag is the catalogue version it was built from, so a
+    // client polling an unchanged catalogue costs one atomic load
+    uint64_t current = catalogue.version();
+    if (etag_matches(req, current)) {
+      set_not_modified(res, current);
+      return;
     }
-    res.set_content(listData, "application/json");
+
+    // Writes mark the listing stale: it keeps being served while one
+    // background refresh rebuilds it, and concurrent misses share one load
+    uint64_t version = 0;
+    CacheValue listData = cache.get_or_load("list_movies", [&catalogue](CacheValue &value, CacheTags &, uint64_t &builtAt) {
+      value = catalogue.list(&builtAt);
+      return value != nullptr;
+    }, scan_cost(catalogue.size()), {}, &version);
+    if (!listData) {
+      // Catalogue is cold: stream rows from MySQL as they arrive
+      stream_movie_list(res, db, catalogue, cache);
+      return;
+    }
+    set_cached_content(req, res, cache, "list_movies", listData, version, "application/json");
     // json parsed = json::parse(listData);
     // res.set_content(parsed.to_string(), "application/json");
   });
 
   // Search a movie
   svr.Get("/search-movie", [&](const httplib::Request &req, httplib::Response &res) {
-    cout << "Received GET /search-movie request" << endl;
+    LOG_DEBUG("Received GET /search-movie request");
 
     if (!req.has_param("title")) {
       res.status = 400;
@@ -92,22 +415,52 @@ int main() {
     }
     
     string title = req.get_param_value("title");
-    string movieData;
     string cacheKey = movie_cache_key(title);
     
-    if (cache.exists(cacheKey)) {
-      movieData = cache.get(cacheKey);
-    } else {
-      if (db.searchMovie(title, movieData)) {
-        cache.put(cacheKey, movieData);
-      }
+    // Titles known to match nothing (or whose search just failed) are
+    // answered without a lookup
+    NegativeKind negative;
+    if (negativeCache.lookup(cacheKey, negative)) {
+      set_shared_content(res, negative == NegativeKind::Empty ? EMPTY_SEARCH_RESULT : FAILED_SEARCH_RESULT,
+                         "application/json");
+      return;
     }
-    res.set_content(movieData, "application/json");
+
+    // Results are tagged with the movies they contain and the query, so
+    // writes invalidate exactly the searches they change; the loader may
+    // run as a background refresh, hence title by value
+    auto loadSearch = [&catalogue, &db, &cache, &negativeCache, title, cacheKey](CacheValue &value, CacheTags &tags, uint64_t &) {
+      // Read before searching: an add that lands during the search clears
+      // the negative cache, and the miss found here is then not recorded
+      uint64_t negativeGeneration = negativeCache.generation();
+      // The catalogue's title index answers without a table scan once warm
+      string searchResult;
+      vector<int> ids;
+      if (!catalogue.search(title, searchResult, ids) && !db.searchMovie(title, searchResult, ids)) {
+        negativeCache.insert(cacheKey, NegativeKind::Failure, negativeGeneration);
+        value = FAILED_SEARCH_RESULT;
+        return false;
+      }
+      if (searchResult == "[]") {
+        // Empty results live in the negative cache only, and replace a
+        // positive entry this load is refreshing
+        negativeCache.insert(cacheKey, NegativeKind::Empty, negativeGeneration);
+        cache.erase(cacheKey);
+        value = EMPTY_SEARCH_RESULT;
+        return false;
+      }
+      value = make_shared<const string>(std::move(searchResult));
+      tags = search_tags(cacheKey, ids);
+      return true;
+    };
+    uint64_t version = 0;
+    CacheValue movieData = cache.get_or_load(cacheKey, loadSearch, 1, SEARCH_EXPIRY, &version);
+    set_cached_content(req, res, cache, cacheKey, movieData, version, "application/json");
   });
 
   // Update rating of a movie
   svr.Put("/update-rating", [&](const httplib::Request &req, httplib::Response &res) {
-    cout << "Received PUT /udpate-rating request" << endl;
+    LOG_DEBUG("Received PUT /udpate-rating request");
 
     if (!req.has_param("id") || !req.has_param("rating")) {
       res.status = 400;
@@ -117,16 +470,14 @@ int main() {
 
     int id = stoi(req.get_param_value("id"));
     double rating = stod(req.get_param_value("rating"));
-    string title;
-    string movieJson;
+    Movie updated;
 
-    if (db.updateRating(id, rating, title, movieJson)) {
-      if (!title.empty()) {
-        string cacheKey = movie_cache_key(title);
-        cache.erase(cacheKey);
-        cache.put(cacheKey, movieJson);
+    if (db.updateRating(id, rating, updated)) {
+      if (!updated.title.empty()) {
+        catalogue.upsert(updated);
+        cache.invalidateTag(movie_tag(id), is_search_key);
       }
-      cache.erase("list_movies");
+      cache.markStale("list_movies");
       res.set_content("Rating updated", "text/plain");
     } else {
       res.status = 500;
@@ -135,7 +486,7 @@ int main() {
   });
 
   svr.Delete("/delete-movie", [&](const httplib::Request &req, httplib::Response &res) {
-    cout << "Received DELETE /delete-movie request" << endl;
+    LOG_DEBUG("Received DELETE /delete-movie request");
 
     if (!req.has_param("id")) {
       res.status = 400;
@@ -147,17 +498,204 @@ int main() {
     string title;
 
     if (db.deleteMovie(id, title)) {
-      if (!title.empty()) cache.erase(movie_cache_key(title));
-      cache.erase("list_movies");
+      catalogue.erase(id);
+      cache.invalidateTag(movie_tag(id), is_search_key);
+      cache.markStale("list_movies");
       res.set_content("Movie deleted", "text/plain");
     } else {
       res.status = 500;
       res.set_content("Deletion failed", "text/plain");
     }
   });
+}
+
+// Load the whole table into the catalogue (and its title index) at startup,
+// so listing and search are served from memory from the first request
+static void warm_catalogue(DBHandler &db, Catalogue &catalogue) {
+  uint64_t ticket = catalogue.beginLoad();
+  vector<CatalogueRow> rows;
+  bool ok = db.listMovies([&](const Movie &movie) {
+    rows.push_back(CatalogueRow{movie, movie_to_json(movie)});
+    return true;
+  });
+  if (!ok || !catalogue.load(ticket, std::move(rows))) {
+    LOG_WARN("Catalogue not loaded at startup, it will load on the first /list-movies");
+  }
+}
+
+// Send the full listing straight from MySQL as a chunked response, so the
+// first bytes go out before the last row has been read. The rows read on
+// the way warm the catalogue and the list_movies cache entry.
+static void stream_movie_list(httplib::Response &res, DBHandler &db, Catalogue &catalogue, Cache &cache) {
+  res.set_chunked_content_provider(
+    "application/json",
+    [&db, &catalogue, &cache](size_t, httplib::DataSink &sink) {
+      uint64_t ticket = catalogue.beginLoad();
+      vector<CatalogueRow> rows;
+      string chunk = "[";
+      bool clientOk = true;
+
+      bool ok = db.listMovies([&](const Movie &movie) {
+        CatalogueRow row{movie, movie_to_json(movie)};
+        if (!rows.empty()) chunk += ',';
+        chunk += row.json;
+        rows.push_back(std::move(row));
+
+        if (chunk.size() >= LIST_CHUNK_SIZE) {
+          clientOk = sink.write(chunk.data(), chunk.size());
+          chunk.clear();
+        }
+        return clientOk;
+      });
+
+      // A listing that failed part way is aborted rather than closed, so
+      // the client sees a broken response instead of a truncated array
+      if (!clientOk) return false;
+      if (!ok) {
+        LOG_WARN("Listing failed after it started streaming, aborting the response");
+        return false;
+      }
+      chunk += ']';
+      clientOk = sink.write(chunk.data(), chunk.size());
+      if (clientOk) sink.done();
+
+      if (catalogue.load(ticket, std::move(rows))) {
+        uint64_t version = 0;
+        CacheValue listing = catalogue.list(&version);
+        if (listing) cache.put("list_movies", listing, scan_cost(catalogue.size()), {}, {}, version);
+      }
+      return clientOk;
+    });
+}
+
+// Serve one keyset page of the listing as {"movies":[...],"next":<id|null>}.
+// Pass next back as after_id to get the following page.
+static void serve_movie_page(const httplib::Request &req, httplib::Response &res,
+                             DBHandler &db, Catalogue &catalogue, Cache &cache) {
+  int afterId = 0;
+  int limit = DEFAULT_PAGE_SIZE;
+  try {
+    if (req.has_param("after_id")) afterId = stoi(req.get_param_value("after_id"));
+    if (req.has_param("limit")) limit = stoi(req.get_param_value("limit"));
+  } catch (const exception &) {
+    limit = 0;
+  }
+  if (afterId < 0 || limit < 1 || limit > MAX_PAGE_SIZE) {
+    res.status = 400;
+    res.set_content("Invalid URL", "text/plain");
+    return;
+  }
+
+  // Pages are keyed by catalogue version, so any write moves readers to
+  // fresh entries and the old ones are evicted by the cache policy
+  string cacheKey = "list_movies:v" + to_string(catalogue.version()) + ":" +
+                    to_string(afterId) + ":" + to_string(limit);
+
+  uint64_t version = 0;
+  CacheValue page = cache.get_or_load(cacheKey, [&](CacheValue &value, CacheTags &, uint64_t &) {
+    string rowsJson;
+    int nextId = 0;
+    if (!catalogue.page(afterId, limit, rowsJson, nextId)) {
+      // Catalogue is cold: read one extra row to learn whether a next page exists
+      vector<Movie> rows;
+      if (!db.listMoviesPage(afterId, limit + 1, rows)) return false;
+      if (rows.size() > static_cast<size_t>(limit)) {
+        rows.pop_back();
+        nextId = rows.back().id;
+      }
+      rowsJson = movies_to_json(rows);
+    }
+
+    string body = "{\"movies\":" + rowsJson + ",\"next\":" + (nextId ? to_string(nextId) : "null") + "}";
+    value = make_shared<const string>(std::move(body));
+    return true;
+  }, scan_cost(limit), {}, &version);
+  if (!page) {
+    res.status = 500;
+    res.set_content("Database read failed", "text/plain");
+    return;
+  }
+  set_cached_content(req, res, cache, cacheKey, page, version, "application/json");
+}
+
+// Cache cost of a result built from this many rows, in single-row lookups,
+// so the eviction policy knows a full listing is expensive to rebuild
+static uint32_t scan_cost(size_t rows) {
+  return static_cast<uint32_t>(max<size_t>(1, min<size_t>(rows, UINT32_MAX)));
+}
+
+// Cache tags of search results. A movie tag is the id of a movie the
+// result contains. A query tag is the first trigram of the lowercased
+// query (every title the query matches contains it); shorter queries
+// share one tag.
+#define MOVIE_TAG 0
+#define QUERY_TAG (1ULL << 32)
+#define SHORT_QUERY_TAG (2ULL << 32)
+#define MOVIE_KEY_PREFIX_SIZE 6  // "movie:"
+
+// Tag for the entries containing movie id
+static uint64_t movie_tag(int id) {
+  return MOVIE_TAG | static_cast<uint32_t>(id);
+}
+
+// Tag for queries starting with the three bytes at s
+static uint64_t trigram_tag(const char *s) {
+  return QUERY_TAG | (uint64_t)(unsigned char)s[0] << 16 | (uint64_t)(unsigned char)s[1] << 8 |
+         (unsigned char)s[2];
+}
+
+// Whether a cache key is a title search, the only entries carrying tags
+static bool is_search_key(const string &key) {
+  return key.compare(0, MOVIE_KEY_PREFIX_SIZE, "movie:") == 0;
+}
 
-  cout << "Server running at http://0.0.0.0:8080" << endl;
-  svr.listen("0.0.0.0", 8080);
+// Tags of a cached search: its movies, then its query
+static CacheTags search_tags(const string &cacheKey, const vector<int> &ids) {
+  CacheTags tags;
+  tags.reserve(ids.size() + 1);
+  for (int id : ids) tags.push_back(movie_tag(id));
+  tags.push_back(cacheKey.size() >= MOVIE_KEY_PREFIX_SIZE + 3 ? trigram_tag(&cacheKey[MOVIE_KEY_PREFIX_SIZE])
+                                                               : SHORT_QUERY_TAG);
+  return tags;
+}
+
+// A new title belongs in every cached search whose query it contains. Those
+// queries start with one of the title's trigrams, so only the entries
+// tagged with those are checked, then matched against the new titles that
+// have the trigram. Each tag is visited once however many titles share it.
+// The matches also pick the searches in flight that could miss a title.
+static void invalidate_matching_searches(Cache &cache, const vector<string> &titles) {
+  vector<string> lowered;
+  lowered.reserve(titles.size());
+  vector<pair<uint64_t, uint32_t>> grams;  // trigram tag, index into lowered
+  for (const string &title : titles) {
+    lowered.push_back(to_lower_ascii(title));
+    const string &l = lowered.back();
+    uint32_t index = static_cast<uint32_t>(lowered.size() - 1);
+    for (size_t i = 0; i + 3 <= l.size(); i++) grams.emplace_back(trigram_tag(&l[i]), index);
+  }
+  sort(grams.begin(), grams.end());
+  grams.erase(unique(grams.begin(), grams.end()), grams.end());
+
+  cache.invalidateTag(SHORT_QUERY_TAG, [&lowered](const string &key) {
+    if (!is_search_key(key)) return false;
+    const char *query = key.c_str() + MOVIE_KEY_PREFIX_SIZE;
+    for (const string &l : lowered) {
+      if (l.find(query) != string::npos) return true;
+    }
+    return false;
+  });
+  for (size_t begin = 0, end; begin < grams.size(); begin = end) {
+    for (end = begin + 1; end < grams.size() && grams[end].first == grams[begin].first; end++) {}
+    cache.invalidateTag(grams[begin].first, [&](const string &key) {
+      if (!is_search_key(key)) return false;
+      const char *query = key.c_str() + MOVIE_KEY_PREFIX_SIZE;
+      for (size_t i = begin; i < end; i++) {
+        if (lowered[grams[i].second].find(query) != string::npos) return true;
+      }
+      return false;
+    });
+  }
 }
 
 // Convert ASCII string to lowercase (simple, fast)
@@ -171,3 +709,94 @@ static string to_lower_ascii(const string &s) {
 static string movie_cache_key(const string &title) {
     return string("movie:") + to_lower_ascii(title);
 }
+
+// Serve a shared cached buffer without copying it into the response body,
+// the provider keeps a reference alive until the body has been written
+static void set_shared_content(httplib::Response &res, CacheValue body, const string &contentType) {
+    size_t bodySize = body->size();
+    res.set_content_provider(
+      bodySize, contentType,
+      [body = std::move(body)](size_t offset, size_t length, httplib::DataSink &sink) {
+        return sink.write(body->data() + offset, length);
+      });
+}
+
+// ETag of a cached value's version: "<epoch>-<version hex>", plus
+// "-<coding>" on a compressed representation
+static string etag_base(uint64_t version) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%llx", static_cast<unsigned long long>(version));
+    return ETAG_EPOCH + "-" + hex;
+}
+
+// Whether If-None-Match names any representation of this version
+// (version 0 has no ETag and never matches)
+static bool etag_matches(const httplib::Request &req, uint64_t version) {
+    if (!version || !req.has_header("If-None-Match")) return false;
+    string header = req.get_header_value("If-None-Match");
+    string base = etag_base(version);
+
+    size_t begin = 0;
+    while (begin < header.size()) {
+      size_t end = header.find(',', begin);
+      if (end == string::npos) end = header.size();
+      string tag = header.substr(begin, end - begin);
+      tag.erase(0, tag.find_first_not_of(" \t"));
+      tag.erase(tag.find_last_not_of(" \t") + 1);
+      if (tag == "*") return true;
+      if (tag.compare(0, 2, "W/") == 0) tag.erase(0, 2);
+      if (tag.size() >= 2 && tag.front() == '"' && tag.back() == '"') tag = tag.substr(1, tag.size() - 2);
+      if (tag.compare(0, base.size(), base) == 0 && (tag.size() == base.size() || tag[base.size()] == '-')) {
+        return true;
+      }
+      begin = end + 1;
+    }
+    return false;
+}
+
+// Answer 304 Not Modified, without a body
+static void set_not_modified(httplib::Response &res, uint64_t version) {
+    res.status = 304;
+    res.set_header("ETag", "\"" + etag_base(version) + "\"");
+    notModifiedResponses.fetch_add(1, memory_order_relaxed);
+}
+
+// Serve a cached body in the coding the client prefers, or 304 when the
+// client already holds this version. The compressed form is built by the
+// first request wanting it and kept with the cache entry, so hits never
+// compress. A body that is not cached is compressed for this response
+// only; one whose form another request is still building goes out
+// uncompressed.
+static void set_cached_content(const httplib::Request &req, httplib::Response &res, Cache &cache,
+                               const string &cacheKey, CacheValue body, uint64_t version,
+                               const string &contentType) {
+    if (etag_matches(req, version)) {
+      set_not_modified(res, version);
+      return;
+    }
+
+    string etag = version ? etag_base(version) : "";
+    if (body->size() < MIN_ENCODED_BODY_BYTES) {
+      if (version) res.set_header("ETag", "\"" + etag + "\"");
+      set_shared_content(res, std::move(body), contentType);
+      return;
+    }
+
+    res.set_header("Vary", "Accept-Encoding");
+    ContentEncoding encoding = preferred_encoding(req.get_header_value("Accept-Encoding"));
+    if (encoding != ContentEncoding::Identity) {
+      size_t slot = static_cast<size_t>(encoding) - 1;
+      CacheValue encoded = cache.variant(cacheKey, body, slot, [encoding](const string &raw) -> CacheValue {
+        string out;
+        if (!encode_body(raw, encoding, out)) return nullptr;
+        return make_shared<const string>(std::move(out));
+      });
+      if (encoded) {
+        res.set_header("Content-Encoding", content_encoding_name(encoding));
+        if (version) etag = etag + "-" + content_encoding_name(encoding);
+        body = std::move(encoded);
+      }
+    }
+    if (version) res.set_header("ETag", "\"" + etag + "\"");
+    set_shared_content(res, std::move(body), contentType);
+}
@@ -0,0 +1,198 @@
+#include "movie.h"
+#include <jsoncons/json_encoder.hpp>
+#include <jsoncons/json_cursor.hpp>
+#include <climits>
+
+// Serialize a movie as a JSON object
+string movie_to_json(const Movie &movie) {
+  string out;
+  append_movie_json(out, movie);
+  return out;
+}
+
+// Append a movie's JSON object to out. Written straight through a streaming
+// encoder, no DOM is built. Keys are emitted in sorted order so the output
+// matches what jsoncons::json produced before.
+void append_movie_json(string &out, const Movie &movie) {
+  jsoncons::compact_json_string_encoder encoder(out);
+  encoder.begin_object();
+  encoder.key("genre");
+  encoder.string_value(movie.genre);
+  encoder.key("id");
+  encoder.int64_value(movie.id);
+  encoder.key("rating");
+  encoder.double_value(movie.rating);
+  encoder.key("release_year");
+  encoder.int64_value(movie.release_year);
+  encoder.key("title");
+  encoder.string_value(movie.title);
+  encoder.end_object();
+  encoder.flush();
+}
+
+// Serialize movies as a JSON array of movie objects
+string movies_to_json(const vector<Movie> &movies) {
+  string out = "[";
+  for (const Movie &movie : movies) {
+    if (out.size() > 1) out += ',';
+    append_movie_json(out, movie);
+  }
+  out += ']';
+  return out;
+}
+
+// Fields a bulk-added movie must have
+#define MOVIE_FIELD_TITLE 1
+#define MOVIE_FIELD_GENRE 2
+#define MOVIE_FIELD_YEAR 4
+#define MOVIE_FIELD_RATING 8
+#define MOVIE_FIELDS_REQUIRED 15
+
+// Describe where the cursor is, for error messages
+static string cursor_position(const jsoncons::json_string_cursor &cursor) {
+  return "line " + to_string(cursor.line()) + ", column " + to_string(cursor.column());
+}
+
+static bool is_number(jsoncons::staj_event_type type) {
+  return type == jsoncons::staj_event_type::int64_value || type == jsoncons::staj_event_type::uint64_value ||
+         type == jsoncons::staj_event_type::double_value;
+}
+
+// Whether a number event is an integer that fits in an int
+static bool is_int(const jsoncons::staj_event &event) {
+  if (event.event_type() == jsoncons::staj_event_type::int64_value) {
+    int64_t value = event.get<int64_t>();
+    return value >= INT_MIN && value <= INT_MAX;
+  }
+  if (event.event_type() == jsoncons::staj_event_type::uint64_value) return event.get<uint64_t>() <= INT_MAX;
+  return false;
+}
+
+// Which required field a member name is, 0 for any other member
+static int movie_field(jsoncons::string_view name) {
+  if (name == "title") return MOVIE_FIELD_TITLE;
+  if (name == "genre") return MOVIE_FIELD_GENRE;
+  if (name == "release_year") return MOVIE_FIELD_YEAR;
+  if (name == "rating") return MOVIE_FIELD_RATING;
+  return 0;
+}
+
+// Read the members of one movie object; the cursor is on its begin_object
+// and is left on its end_object
+static bool read_movie(jsoncons::json_string_cursor &cursor, Movie &movie, string &error) {
+  error_code ec;
+  int seen = 0;
+  int field = 0;
+  while (true) {
+    cursor.next(ec);
+    if (ec || cursor.done()) {
+      error = "Invalid JSON at " + cursor_position(cursor);
+      return false;
+    }
+    const jsoncons::staj_event &event = cursor.current();
+    jsoncons::staj_event_type type = event.event_type();
+    if (type == jsoncons::staj_event_type::end_object) break;
+    if (type == jsoncons::staj_event_type::key) {
+      field = movie_field(event.get<jsoncons::string_view>());
+      continue;
+    }
+
+    if (field == MOVIE_FIELD_TITLE || field == MOVIE_FIELD_GENRE) {
+      if (type != jsoncons::staj_event_type::string_value) {
+        error = string(field == MOVIE_FIELD_TITLE ? "title" : "genre") + " must be a string at " +
+                cursor_position(cursor);
+        return false;
+      }
+      jsoncons::string_view value = event.get<jsoncons::string_view>();
+      (field == MOVIE_FIELD_TITLE ? movie.title : movie.genre).assign(value.data(), value.size());
+    } else if (field == MOVIE_FIELD_YEAR || field == MOVIE_FIELD_RATING) {
+      if (!is_number(type)) {
+        error = string(field == MOVIE_FIELD_YEAR ? "release_year" : "rating") + " must be a number at " +
+                cursor_position(cursor);
+        return false;
+      }
+      if (field == MOVIE_FIELD_YEAR) {
+        if (!is_int(event)) {
+          error = "release_year must be an integer at " + cursor_position(cursor);
+          return false;
+        }
+        movie.release_year = static_cast<int>(event.get<int64_t>());
+      } else {
+        movie.rating = event.get<double>();
+      }
+    } else if (type == jsoncons::staj_event_type::begin_object || type == jsoncons::staj_event_type::begin_array) {
+      // Unknown member holding an object or array: skip all of it
+      for (int depth = 1; depth > 0;) {
+        cursor.next(ec);
+        if (ec || cursor.done()) {
+          error = "Invalid JSON at " + cursor_position(cursor);
+          return false;
+        }
+        jsoncons::staj_event_type inner = cursor.current().event_type();
+        if (inner == jsoncons::staj_event_type::begin_object || inner == jsoncons::staj_event_type::begin_array) {
+          depth++;
+        } else if (inner == jsoncons::staj_event_type::end_object || inner == jsoncons::staj_event_type::end_array) {
+          depth--;
+        }
+      }
+    }
+    seen |= field;
+  }
+
+  if (seen != MOVIE_FIELDS_REQUIRED) {
+    error = "Movie ending at " + cursor_position(cursor) + " needs title, genre, release_year and rating";
+    return false;
+  }
+  return true;
+}
+
+// Walk the body with a streaming cursor, so no DOM is built for it
+bool parse_movies(const string &body, vector<Movie> &movies, string &error) {
+  error_code ec;
+  jsoncons::json_string_cursor cursor(body, ec);
+  bool array = false;
+  while (!ec && !cursor.done()) {
+    jsoncons::staj_event_type type = cursor.current().event_type();
+    if (type == jsoncons::staj_event_type::begin_array && !array && movies.empty()) {
+      // One array of movies: it must be the whole body
+      array = true;
+      cursor.next(ec);
+      continue;
+    }
+    if (array && type == jsoncons::staj_event_type::end_array) {
+      cursor.next(ec);
+      if (!ec && !cursor.done()) break;
+      cursor.reset(ec);
+      if (ec == jsoncons::json_errc::unexpected_eof) return true;
+      error = "Unexpected data after the array of movies";
+      return false;
+    }
+    if (type != jsoncons::staj_event_type::begin_object) {
+      error = "Expected a movie object at " + cursor_position(cursor);
+      return false;
+    }
+
+    Movie movie;
+    try {
+      if (!read_movie(cursor, movie, error)) return false;
+    } catch (const exception &e) {
+      error = "Invalid value at " + cursor_position(cursor) + ": " + e.what();
+      return false;
+    }
+    movies.push_back(std::move(movie));
+
+    if (array) {
+      cursor.next(ec);
+    } else {
+      // Next line of NDJSON; nothing left but whitespace ends the body
+      cursor.reset(ec);
+      if (ec == jsoncons::json_errc::unexpected_eof) return true;
+    }
+  }
+
+  if (ec || array) {
+    error = "Invalid JSON at " + cursor_position(cursor);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// One row of the movies table
+struct Movie {
+  int id = 0;
+  string title;
+  string genre;
+  int release_year = 0;
+  double rating = 0.0;
+};
+
+// Serialize a movie as a JSON object, same layout the API has always returned
+string movie_to_json(const Movie &movie);
+
+// Append a movie's JSON object to a reusable buffer
+void append_movie_json(string &out, const Movie &movie);
+
+// Serialize movies as a JSON array of movie objects
+string movies_to_json(const vector<Movie> &movies);
+
+// Parse the body of a bulk add: a JSON array of movie objects, or one
+// object per line (NDJSON). Each needs title, genre, release_year and
+// rating; ids are ignored. On failure error says what is wrong and where.
+bool parse_movies(const string &body, vector<Movie> &movies, string &error);
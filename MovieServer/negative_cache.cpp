@@ -0,0 +1,89 @@
+#include "negative_cache.h"
+#include "logger.h"
+
+using Clock = chrono::steady_clock;
+
+// Constructor
+NegativeCache::NegativeCache(size_t capacity, chrono::milliseconds emptyTtl, chrono::milliseconds failureTtl)
+    : capacity(capacity), emptyTtl(emptyTtl), failureTtl(failureTtl) {}
+
+// Whether key is known to have no result; kind tells empty from failed
+bool NegativeCache::lookup(const string &key, NegativeKind &kind) {
+  uint64_t h = hasher(key);
+  lock_guard<mutex> lock(mtx);
+  auto it = entries.find(h);
+  if (it == entries.end()) return false;
+  if (Clock::now() >= it->second.expiresAt) {
+    entries.erase(it);
+    return false;
+  }
+  kind = it->second.kind;
+  hits++;
+  LOG_TRACE("Negative cache hit for: %s", key.c_str());
+  return true;
+}
+
+// Generation to stamp inserts with, read before the lookup they record
+uint64_t NegativeCache::generation() const {
+  lock_guard<mutex> lock(mtx);
+  return currentGeneration;
+}
+
+// Record that key has no result, for the TTL of its kind, unless the
+// cache was cleared since generation was read
+void NegativeCache::insert(const string &key, NegativeKind kind, uint64_t generation) {
+  if (capacity == 0) return;
+  uint64_t h = hasher(key);
+  Clock::time_point expiresAt = Clock::now() + (kind == NegativeKind::Empty ? emptyTtl : failureTtl);
+
+  lock_guard<mutex> lock(mtx);
+  if (generation != currentGeneration) return;
+  auto it = entries.find(h);
+  if (it != entries.end()) {
+    // Renewed in place, keeping its age for eviction
+    it->second.expiresAt = expiresAt;
+    it->second.kind = kind;
+    return;
+  }
+  uint64_t sequence = nextSequence++;
+  entries.emplace(h, Entry{expiresAt, sequence, kind});
+  order.emplace_back(h, sequence);
+
+  // Drop the oldest entries over capacity. Slots of entries that expired
+  // or were erased (and maybe inserted again since) are skipped; trimming
+  // at twice the capacity keeps them from piling up.
+  while (entries.size() > capacity || order.size() > 2 * capacity) {
+    auto oldest = order.front();
+    order.pop_front();
+    auto it = entries.find(oldest.first);
+    if (it != entries.end() && it->second.sequence == oldest.second) entries.erase(it);
+  }
+  LOG_TRACE("Negative cache put: %s", key.c_str());
+}
+
+// Forget key
+void NegativeCache::erase(const string &key) {
+  uint64_t h = hasher(key);
+  lock_guard<mutex> lock(mtx);
+  entries.erase(h);
+}
+
+// Forget every key, e.g. when a new title may match any of them
+void NegativeCache::clear() {
+  lock_guard<mutex> lock(mtx);
+  entries.clear();
+  order.clear();
+  currentGeneration++;
+}
+
+// Number of keys held (expired ones included until looked up or evicted)
+size_t NegativeCache::size() const {
+  lock_guard<mutex> lock(mtx);
+  return entries.size();
+}
+
+// Lookups answered from the negative cache
+size_t NegativeCache::hitCount() const {
+  lock_guard<mutex> lock(mtx);
+  return hits;
+}
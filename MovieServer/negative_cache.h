@@ -0,0 +1,56 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+
+// Why a lookup produced nothing worth caching
+enum class NegativeKind : uint8_t {
+  Empty,    // the query matched no movie
+  Failure   // the database read failed
+};
+
+// Remembers keys whose lookup came back empty or failed, so repeated
+// lookups for absent titles stop reaching MySQL. Kept apart from Cache:
+// an entry is only the key's 64-bit hash, an expiry and a kind (no key or
+// value bytes), it has its own short TTLs, and its own entry limit, so a
+// flood of distinct misses cannot evict real results. When full, the
+// oldest entry goes. Every clear() starts a new generation, and an insert
+// stamped with an earlier one is dropped: a lookup that ran before a write
+// cleared the cache must not record the miss that write just fixed.
+class NegativeCache {
+  private:
+    struct Entry {
+      chrono::steady_clock::time_point expiresAt;
+      uint64_t sequence;  // identifies this entry's slot in order
+      NegativeKind kind;
+    };
+
+    size_t capacity;
+    chrono::milliseconds emptyTtl;
+    chrono::milliseconds failureTtl;
+    unordered_map<uint64_t, Entry> entries;
+    deque<pair<uint64_t, uint64_t>> order;  // (hash, sequence), oldest first
+    uint64_t nextSequence = 0;
+    uint64_t currentGeneration = 0;  // bumped by clear()
+    size_t hits = 0;
+    hash<string> hasher;
+    mutable mutex mtx;
+
+  public:
+    NegativeCache(size_t capacity, chrono::milliseconds emptyTtl, chrono::milliseconds failureTtl);
+
+    bool lookup(const string &key, NegativeKind &kind);
+    uint64_t generation() const;
+    void insert(const string &key, NegativeKind kind, uint64_t generation);
+    void erase(const string &key);
+    void clear();
+    size_t size() const;
+    size_t hitCount() const;
+};
@@ -0,0 +1,85 @@
+#include "task_queue.h"
+
+// Same count httplib sizes its default ThreadPool with
+size_t default_worker_count() {
+  return CPPHTTPLIB_THREAD_POOL_COUNT;
+}
+
+// Start the workers
+WorkStealingQueue::WorkStealingQueue(size_t threads, size_t maxQueued) : maxQueued(maxQueued) {
+  if (threads == 0) threads = 1;
+  workers.reserve(threads);
+  for (size_t i = 0; i < threads; i++) workers.push_back(make_unique<Worker>());
+  for (size_t i = 0; i < threads; i++) workers[i]->runner = thread(&WorkStealingQueue::run, this, i);
+}
+
+// Stop the workers if the server did not
+WorkStealingQueue::~WorkStealingQueue() {
+  shutdown();
+}
+
+// Deal a job to the next worker's deque and wake a sleeper if there is one.
+// Fails when maxQueued jobs are already waiting.
+bool WorkStealingQueue::enqueue(function<void()> fn) {
+  if (maxQueued > 0 && pending.load(memory_order_relaxed) >= maxQueued) return false;
+
+  Worker &worker = *workers[nextWorker.fetch_add(1, memory_order_relaxed) % workers.size()];
+  {
+    // Counted under the deque's lock so that take() never runs ahead of it.
+    // Pairs with the sleeper count taken in run(): either this sees the
+    // sleeper or the sleeper sees the job.
+    lock_guard<mutex> lock(worker.mtx);
+    worker.jobs.push_back(std::move(fn));
+    pending.fetch_add(1, memory_order_seq_cst);
+  }
+  if (sleepers.load(memory_order_seq_cst) > 0) {
+    lock_guard<mutex> lock(sleepMtx);
+    wake.notify_one();
+  }
+  return true;
+}
+
+// Let the workers drain what is queued, then join them
+void WorkStealingQueue::shutdown() {
+  {
+    lock_guard<mutex> lock(sleepMtx);
+    if (stopping) return;
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) worker->runner.join();
+}
+
+// Pop the oldest job of the worker's own deque, or else steal the oldest
+// job of the next worker that has one
+bool WorkStealingQueue::take(size_t self, function<void()> &job) {
+  size_t n = workers.size();
+  for (size_t i = 0; i < n; i++) {
+    Worker &victim = *workers[(self + i) % n];
+    lock_guard<mutex> lock(victim.mtx);
+    if (victim.jobs.empty()) continue;
+    job = std::move(victim.jobs.front());
+    victim.jobs.pop_front();
+    pending.fetch_sub(1, memory_order_relaxed);
+    if (i > 0) steals.fetch_add(1, memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+// Worker loop: run jobs while there are any, sleep when all deques are empty
+void WorkStealingQueue::run(size_t self) {
+  for (;;) {
+    function<void()> job;
+    if (take(self, job)) {
+      job();
+      continue;
+    }
+
+    unique_lock<mutex> lock(sleepMtx);
+    sleepers.fetch_add(1, memory_order_seq_cst);
+    wake.wait(lock, [this] { return stopping || pending.load(memory_order_seq_cst) > 0; });
+    sleepers.fetch_sub(1, memory_order_relaxed);
+    if (stopping && pending.load(memory_order_seq_cst) == 0) return;
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <httplib.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Default HTTP worker count: what httplib's ThreadPool would use
+size_t default_worker_count();
+
+// httplib task queue with one job deque per worker instead of a single
+// mutex+condvar queue. Accepted connections are dealt to the workers
+// round-robin; a worker whose deque is empty steals the oldest job of
+// another before going to sleep. Sleepers are woken only when there are
+// some, so enqueue normally touches just one worker's lock.
+class WorkStealingQueue : public httplib::TaskQueue {
+  private:
+    struct Worker {
+      mutex mtx;
+      deque<function<void()>> jobs;
+      thread runner;
+    };
+
+    vector<unique_ptr<Worker>> workers;
+    size_t maxQueued;                  // 0 = unbounded
+    atomic<size_t> nextWorker{0};
+    atomic<size_t> pending{0};         // jobs queued and not yet taken
+    atomic<size_t> sleepers{0};
+    atomic<size_t> steals{0};
+    mutex sleepMtx;
+    condition_variable wake;
+    bool stopping = false;
+
+    bool take(size_t self, function<void()> &job);
+    void run(size_t self);
+
+  public:
+    explicit WorkStealingQueue(size_t threads, size_t maxQueued = 0);
+    ~WorkStealingQueue() override;
+
+    bool enqueue(function<void()> fn) override;
+    void shutdown() override;
+
+    size_t workerCount() const { return workers.size(); }
+    size_t stealCount() const { return steals.load(memory_order_relaxed); }
+};
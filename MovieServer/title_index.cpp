@@ -0,0 +1,116 @@
+#include "title_index.h"
+#include <algorithm>
+#include <cctype>
+
+// Lowercase ASCII letters, same folding the cache keys use
+static string fold_case(const string &s) {
+  string out = s;
+  transform(out.begin(), out.end(), out.begin(), ::tolower);
+  return out;
+}
+
+// Distinct trigrams of an already lowercased string
+void TitleIndex::trigrams(const string &lowered, vector<uint32_t> &out) {
+  out.clear();
+  for (size_t i = 0; i + 3 <= lowered.size(); i++) {
+    out.push_back(static_cast<uint32_t>(static_cast<unsigned char>(lowered[i])) << 16 |
+                  static_cast<uint32_t>(static_cast<unsigned char>(lowered[i + 1])) << 8 |
+                  static_cast<uint32_t>(static_cast<unsigned char>(lowered[i + 2])));
+  }
+  sort(out.begin(), out.end());
+  out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+// Index a title (replaces any title already indexed under the id)
+void TitleIndex::add(int id, const string &title) {
+  if (titles.count(id)) remove(id);
+  string lowered = fold_case(title);
+
+  vector<uint32_t> grams;
+  trigrams(lowered, grams);
+  for (uint32_t gram : grams) {
+    vector<int> &ids = postings[gram];
+    // Ids are auto-increment, so this is almost always an append
+    if (ids.empty() || ids.back() < id) {
+      ids.push_back(id);
+    } else {
+      ids.insert(lower_bound(ids.begin(), ids.end(), id), id);
+    }
+  }
+  titles.emplace(id, std::move(lowered));
+}
+
+// Drop a title from the index
+void TitleIndex::remove(int id) {
+  auto it = titles.find(id);
+  if (it == titles.end()) return;
+
+  vector<uint32_t> grams;
+  trigrams(it->second, grams);
+  for (uint32_t gram : grams) {
+    auto p = postings.find(gram);
+    if (p == postings.end()) continue;
+    vector<int> &ids = p->second;
+    auto pos = lower_bound(ids.begin(), ids.end(), id);
+    if (pos != ids.end() && *pos == id) ids.erase(pos);
+    if (ids.empty()) postings.erase(p);
+  }
+  titles.erase(it);
+}
+
+// Drop everything
+void TitleIndex::clear() {
+  postings.clear();
+  titles.clear();
+}
+
+// Ids (ascending) of titles containing query, ignoring ASCII case. Queries
+// of three or more characters intersect the posting lists of their
+// trigrams, starting from the rarest, and only the surviving candidates
+// are checked with a substring match. Shorter queries have no trigram and
+// fall back to checking every title. LIKE wildcards (% and _) in the
+// query are matched literally.
+vector<int> TitleIndex::search(const string &query) const {
+  string needle = fold_case(query);
+  vector<int> result;
+
+  if (needle.size() < 3) {
+    for (const auto &kv : titles) {
+      if (kv.second.find(needle) != string::npos) result.push_back(kv.first);
+    }
+    sort(result.begin(), result.end());
+    return result;
+  }
+
+  vector<uint32_t> grams;
+  trigrams(needle, grams);
+  vector<const vector<int> *> lists;
+  for (uint32_t gram : grams) {
+    auto p = postings.find(gram);
+    if (p == postings.end()) return result;  // some trigram occurs nowhere
+    lists.push_back(&p->second);
+  }
+  sort(lists.begin(), lists.end(), [](const vector<int> *a, const vector<int> *b) {
+    return a->size() < b->size();
+  });
+
+  vector<int> candidates = *lists[0];
+  vector<int> merged;
+  for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+    merged.clear();
+    set_intersection(candidates.begin(), candidates.end(), lists[i]->begin(), lists[i]->end(),
+                     back_inserter(merged));
+    candidates.swap(merged);
+  }
+
+  // Trigrams can all be present without being adjacent, confirm the match
+  for (int id : candidates) {
+    if (titles.at(id).find(needle) != string::npos) result.push_back(id);
+  }
+  return result;
+}
+
+// Number of indexed titles
+size_t TitleIndex::size() const {
+  return titles.size();
+}
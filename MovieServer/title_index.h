@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Trigram index over movie titles answering case-insensitive substring
+// queries (what LOWER(title) LIKE '%x%' did) without scanning every title.
+// Not thread-safe, the owner provides locking.
+class TitleIndex {
+  private:
+    unordered_map<uint32_t, vector<int>> postings; // trigram -> sorted ids of titles containing it
+    unordered_map<int, string> titles;             // id -> lowercased title, used to verify candidates
+
+    static void trigrams(const string &lowered, vector<uint32_t> &out);
+
+  public:
+    void add(int id, const string &title);
+    void remove(int id);
+    void clear();
+
+    vector<int> search(const string &query) const;
+    size_t size() const;
+};